@@ -0,0 +1,732 @@
+/**
+* Byak, a UCI chess engine.
+* Copyright (C) 2013  Sylvain Philip
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include "types.h"
+#include "position.h"
+#include "search.h"
+#include "uci.h"
+#include "timer.h"
+#include "thread.h"
+#include "analyze.h"
+
+/* Longest EPD line */
+#define RECORD_SIZE 1024
+
+/*
+A worker doesn't start a record this many records ahead of the first one
+not written yet, per worker. This bounds the results waiting to be written
+in the order of the file.
+*/
+#define RECORDS_AHEAD 4
+
+/* Depth searched when no limit is given */
+#define DEFAULT_DEPTH 10
+
+/* Longest game analyzed, in plies */
+#define GAME_MAX_MOVES POSITION_HISTORY
+
+/*
+Classification of the moves of a game by the score lost against the best
+move. Scores are capped, missing a faster mate in a won position is no error.
+*/
+#define GAME_SCORE_CAP  1000
+#define INACCURACY_LOSS 50
+#define MISTAKE_LOSS    100
+#define BLUNDER_LOSS    300
+
+typedef struct {
+	Thread handle;
+	SearchThread * thread;
+	SearchInfos search;
+} Worker;
+
+static Mutex lock;
+static Cond changed;
+static int initialized = 0;
+
+/* State of the running analysis, protected by lock */
+static FILE * input;
+static FILE * output;
+static long next_read;    // Index of the next record to search
+static long next_write;   // Index of the next record to write
+static char ** results;   // Searched records waiting for the previous ones, by index modulo window
+static int window;
+static Worker * workers;
+static int workers_count;
+static SearchInfos * game_search; // Search of analyze_game()
+static atomic_int aborted;
+
+/* Limits of every search */
+static SearchInfos limits;
+
+/* depth, nodes or movetime token of a command, returns 0 for other tokens */
+static int readLimit(const char * token, long long value)
+{
+	if (!strcmp(token, "depth")) {
+		limits.depth = MAX(value, 1);
+	}
+	else if (!strcmp(token, "nodes")) {
+		limits.nodes = MAX(value, 1);
+	}
+	else if (!strcmp(token, "movetime")) {
+		limits.movetime = MAX(value, 1);
+	}
+	else {
+		return 0;
+	}
+
+	return 1;
+}
+
+/* Next record of the file, empty lines and comments are skipped */
+static int readRecord(char * record)
+{
+	while (fgets(record, RECORD_SIZE, input)) {
+		record[strcspn(record, "\r\n")] = '\0';
+
+		if (record[0] && record[0] != '#') return 1;
+	}
+
+	return 0;
+}
+
+/*
+The FEN of an EPD record: its four first fields, and the clocks when the
+record is a complete FEN. The operations are dropped.
+*/
+static void recordFen(const char * record, char * fen)
+{
+	char field[RECORD_SIZE];
+	int offset = 0, read, fields = 0;
+
+	fen[0] = '\0';
+
+	while (sscanf(record + offset, "%1023s%n", field, &read) == 1) {
+		offset += read;
+
+		if (fields >= 4 && (fields >= 6 || strspn(field, "0123456789") != strlen(field))) break;
+
+		if (fields) strcat(fen, " ");
+		strcat(fen, field);
+		fields++;
+	}
+}
+
+/* Search a record, the result is to be freed by the caller */
+static char * analyse(Worker * worker, const char * record)
+{
+	char fen[RECORD_SIZE];
+	char * result;
+	int length, i;
+	SearchThread * th = worker->thread;
+
+	recordFen(record, fen);
+
+	result = malloc(strlen(fen) + 64 + MAX_PLY * 6);
+	if (!result) return NULL;
+
+	position_init();
+
+	if (position_fromFen(fen) < 0 || !pos.bb_pieces[K] || !pos.bb_pieces[k]) {
+		sprintf(result, "%s; none; 0; invalid position\n", fen);
+		return result;
+	}
+
+	/* A stop received between two positions holds for this one */
+	mutex_lock(&lock);
+	worker->search = limits;
+	worker->search.stop = aborted;
+	mutex_unlock(&lock);
+
+	worker->search.root = pos;
+	search_single(worker->thread, &worker->search);
+
+	length = sprintf(result, "%s; ", fen);
+
+	/* The PV of the last completed iteration goes with its score */
+	if (!th->pv_length) {
+		/* Checkmate or stalemate */
+		sprintf(result + length, "none; %d;\n", pos.in_check ? -INFINITY : 0);
+		return result;
+	}
+
+	length += uci_format_move(result + length, &th->pv[0]);
+	length += sprintf(result + length, "; %d;", th->score);
+
+	for (i=0; i < th->pv_length; i++) {
+		result[length++] = ' ';
+		length += uci_format_move(result + length, &th->pv[i]);
+	}
+
+	sprintf(result + length, "\n");
+
+	return result;
+}
+
+static void * analyze_worker(void * data)
+{
+	Worker * worker = data;
+	char record[RECORD_SIZE];
+	char * result;
+	long index;
+
+	while (1) {
+		mutex_lock(&lock);
+
+		while (!aborted && next_read - next_write >= window) {
+			cond_wait(&changed, &lock);
+		}
+
+		if (aborted || !readRecord(record)) {
+			mutex_unlock(&lock);
+			break;
+		}
+
+		index = next_read++;
+		mutex_unlock(&lock);
+
+		result = analyse(worker, record);
+
+		mutex_lock(&lock);
+
+		/* An interrupted search is not written, the analysis resumes from it */
+		if (aborted || !result) {
+			aborted = 1;
+			free(result);
+			cond_broadcast(&changed);
+			mutex_unlock(&lock);
+			break;
+		}
+
+		results[index % window] = result;
+
+		while (results[next_write % window]) {
+			fputs(results[next_write % window], output);
+			free(results[next_write % window]);
+			results[next_write % window] = NULL;
+			next_write++;
+		}
+		fflush(output);
+
+		cond_broadcast(&changed);
+		mutex_unlock(&lock);
+	}
+
+	return NULL;
+}
+
+void analyze_stop()
+{
+	int i;
+
+	if (!initialized) return;
+
+	mutex_lock(&lock);
+	aborted = 1;
+	for (i=0; i < workers_count; i++) {
+		workers[i].search.stop = 1;
+	}
+	if (game_search) game_search->stop = 1;
+	cond_broadcast(&changed);
+	mutex_unlock(&lock);
+}
+
+static void init()
+{
+	if (!initialized) {
+		mutex_init(&lock);
+		cond_init(&changed);
+		initialized = 1;
+	}
+}
+
+void analyze_run(const char * args)
+{
+	char token[256], path[256] = "", output_path[256] = "";
+	char record[RECORD_SIZE];
+	int offset = 0, read, threads = 1, i;
+	long resume = 0;
+	U64 start = GET_TIME();
+
+	init();
+
+	memset(&limits, 0, sizeof(limits));
+
+	if (sscanf(args, "%255s%n", path, &read) == 1) {
+		offset += read;
+	}
+
+	while (sscanf(args + offset, "%255s%n", token, &read) == 1) {
+		long long value = 0;
+
+		offset += read;
+
+		if (!strcmp(token, "output")) {
+			if (sscanf(args + offset, "%255s%n", output_path, &read) == 1) offset += read;
+			continue;
+		}
+
+		if (sscanf(args + offset, "%lld%n", &value, &read) == 1) offset += read;
+
+		if (readLimit(token, value)) {
+			continue;
+		}
+		else if (!strcmp(token, "threads")) {
+			threads = MIN(MAX(value, 1), MAX_THREADS);
+		}
+		else if (!strcmp(token, "resume")) {
+			resume = MAX(value, 0);
+		}
+	}
+
+	if (!limits.depth && !limits.nodes && !limits.movetime) {
+		limits.depth = DEFAULT_DEPTH;
+	}
+
+	input = fopen(path, "r");
+	if (!input) {
+		printf("info string cannot open %s\n", path);
+		return;
+	}
+
+	/* The records already analyzed are appended to */
+	output = stdout;
+	if (output_path[0]) {
+		output = fopen(output_path, resume ? "a" : "w");
+		if (!output) {
+			printf("info string cannot open %s\n", output_path);
+			fclose(input);
+			return;
+		}
+	}
+
+	for (next_read = 0; next_read < resume && readRecord(record); next_read++);
+	next_write = next_read;
+
+	window = threads * RECORDS_AHEAD;
+	results = calloc(window, sizeof(char *));
+	workers = calloc(threads, sizeof(Worker));
+	aborted = 0;
+
+	mutex_lock(&lock);
+	for (workers_count = 0; workers && results && workers_count < threads; workers_count++) {
+		Worker * worker = &workers[workers_count];
+
+		worker->thread = search_newThread();
+		if (!worker->thread || !thread_create(&worker->handle, analyze_worker, worker)) {
+			search_freeThread(worker->thread);
+			break;
+		}
+	}
+	mutex_unlock(&lock);
+
+	for (i=0; i < workers_count; i++) {
+		thread_join(workers[i].handle);
+	}
+
+	mutex_lock(&lock);
+	for (i=0; i < workers_count; i++) {
+		search_freeThread(workers[i].thread);
+	}
+	for (i=0; results && i < window; i++) {
+		free(results[i]);
+	}
+	free(results);
+	free(workers);
+	results = NULL;
+	workers = NULL;
+	workers_count = 0;
+	mutex_unlock(&lock);
+
+	if (output != stdout) fclose(output);
+	fclose(input);
+
+	printf("info string analyzed records %ld to %ld in %llu ms%s\n", resume, next_write,
+	       ULL(GET_TIME() - start), aborted ? ", interrupted" : "");
+}
+
+/*
+Legal move of the current position written in coordinate notation or in
+SAN, returns 0 if there is no such move
+*/
+static int parseMove(const char * text, Move * move)
+{
+	Move movelist[MAX_MOVES];
+	char san[16];
+	int listLen = position_generateMoves(movelist);
+	int i, length, piece = P, castle = 0;
+	int from_file = -1, from_rank = -1, to;
+	char promotion = ' ';
+
+	/* Coordinate notation */
+	if (strlen(text) >= 4 && text[0] >= 'a' && text[0] <= 'h' && text[1] >= '1' && text[1] <= '8'
+		&& text[2] >= 'a' && text[2] <= 'h' && text[3] >= '1' && text[3] <= '8') {
+
+		for (i=0; i < listLen; i++) {
+			if (movelist[i].from == (text[1] - '1') * 8 + text[0] - 'a'
+				&& movelist[i].to == (text[3] - '1') * 8 + text[2] - 'a'
+				&& (!(movelist[i].flags & MOVE_PROMOTION) || move_getPromotionPieceChar(movelist[i].flags) == text[4])) {
+				*move = movelist[i];
+				return 1;
+			}
+		}
+		return 0;
+	}
+
+	/* SAN, without the check and annotation symbols */
+	length = strcspn(text, "+#!?");
+	if (length >= (int) sizeof(san)) return 0;
+	memcpy(san, text, length);
+	san[length] = '\0';
+
+	if (!strcmp(san, "O-O") || !strcmp(san, "0-0")) castle = MOVE_CASTLE_KS;
+	if (!strcmp(san, "O-O-O") || !strcmp(san, "0-0-0")) castle = MOVE_CASTLE_QS;
+
+	if (castle) {
+		for (i=0; i < listLen; i++) {
+			if ((movelist[i].flags & MOVE_CASTLE)
+				&& (movelist[i].to & 7) == ((castle == MOVE_CASTLE_KS) ? 6 : 2)) {
+				*move = movelist[i];
+				return 1;
+			}
+		}
+		return 0;
+	}
+
+	/* Promotion: e8=Q or e8Q */
+	if (length >= 2 && strchr("QRBN", san[length - 1])) {
+		promotion = san[length - 1] - 'A' + 'a';
+		san[--length] = '\0';
+		if (length && san[length - 1] == '=') san[--length] = '\0';
+	}
+
+	if (length < 2) return 0;
+
+	switch (san[0]) {
+		case 'K': piece = K; break;
+		case 'Q': piece = Q; break;
+		case 'R': piece = R; break;
+		case 'B': piece = B; break;
+		case 'N': piece = N; break;
+	}
+
+	to = (san[length - 1] - '1') * 8 + san[length - 2] - 'a';
+	if (to < 0 || to > 63) return 0;
+
+	/* Disambiguation, between the piece and the destination */
+	for (i = (piece == P) ? 0 : 1; i < length - 2; i++) {
+		if (san[i] >= 'a' && san[i] <= 'h') from_file = san[i] - 'a';
+		if (san[i] >= '1' && san[i] <= '8') from_rank = san[i] - '1';
+	}
+
+	for (i=0; i < listLen; i++) {
+		Move * m = &movelist[i];
+
+		/* The white and black pieces of a kind only differ by the lowest bit */
+		if ((pos.board[m->from] & ~1) != piece || m->to != to) continue;
+		if (from_file >= 0 && (m->from & 7) != from_file) continue;
+		if (from_rank >= 0 && (m->from >> 3) != from_rank) continue;
+		if ((m->flags & MOVE_PROMOTION) && move_getPromotionPieceChar(m->flags) != promotion) continue;
+
+		*move = *m;
+		return 1;
+	}
+
+	return 0;
+}
+
+/*
+Moves of the first game of a PGN text, or of a plain move list. Tags,
+comments, variations, move numbers and NAGs are skipped. The position is
+set to the start of the game, and left at its end.
+*/
+static int readGame(const char * text, Move * moves, int max)
+{
+	char token[64];
+	char fen[RECORD_SIZE] = "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1";
+	const char * start = text;
+	int count = 0, length, nesting;
+
+	/* The tags come first, FEN sets up the start position */
+	while (*text) {
+		text += strspn(text, " \t\r\n");
+
+		if (*text != '[') break;
+
+		length = strcspn(text, "]");
+		if (!strncmp(text, "[FEN \"", 6)) {
+			int fen_length = strcspn(text + 6, "\"");
+			if (fen_length < RECORD_SIZE) {
+				memcpy(fen, text + 6, fen_length);
+				fen[fen_length] = '\0';
+			}
+		}
+		text += length + (text[length] == ']');
+	}
+
+	position_init();
+	if (position_fromFen(fen) < 0) return -1;
+
+	while (*text && count < max) {
+		if (strchr(" \t\r\n.", *text)) {
+			text++;
+			continue;
+		}
+
+		/* A new game starts */
+		if (*text == '[' && text != start) break;
+
+		if (*text == '{') {
+			text += strcspn(text, "}");
+			if (*text) text++;
+			continue;
+		}
+
+		if (*text == ';') {
+			text += strcspn(text, "\n");
+			continue;
+		}
+
+		if (*text == '(') {
+			for (nesting = 0; *text; text++) {
+				if (*text == '(') nesting++;
+				if (*text == ')' && !--nesting) break;
+			}
+			if (*text) text++;
+			continue;
+		}
+
+		length = strcspn(text, " \t\r\n{}();[");
+		if (length >= (int) sizeof(token)) return -1;
+		memcpy(token, text, length);
+		token[length] = '\0';
+		text += length;
+
+		/* NAG */
+		if (token[0] == '$') continue;
+
+		/* Move number, 12. or 12... possibly followed by the move */
+		if (token[0] >= '0' && token[0] <= '9' && strchr(token, '.')) {
+			char * move = strrchr(token, '.') + 1;
+			memmove(token, move, strlen(move) + 1);
+			if (!token[0]) continue;
+		}
+
+		/* Result */
+		if (!strcmp(token, "1-0") || !strcmp(token, "0-1") || !strcmp(token, "1/2-1/2") || !strcmp(token, "*")) break;
+
+		if (!strcmp(token, "moves")) continue;
+
+		if (!parseMove(token, &moves[count])) {
+			printf("info string illegal move %s\n", token);
+			return -1;
+		}
+
+		position_makeMove(&moves[count]);
+		count++;
+	}
+
+	return count;
+}
+
+/* Scores beyond a won position are all the same for the classification */
+static int clampScore(int score)
+{
+	return MIN(MAX(score, -GAME_SCORE_CAP), GAME_SCORE_CAP);
+}
+
+static const char * classify(int loss, int best)
+{
+	if (best) return "best";
+	if (loss >= BLUNDER_LOSS) return "blunder";
+	if (loss >= MISTAKE_LOSS) return "mistake";
+	if (loss >= INACCURACY_LOSS) return "inaccuracy";
+	return "good";
+}
+
+void analyze_game(const char * args)
+{
+	char token[256];
+	int offset = 0, read, count, i, j;
+	int first;       // First position analyzed, the analysis goes backward
+	int start_side, start_fullmove;
+	int played[2] = {0}, errors[2][3] = {{0}};
+	long loss_sum[2] = {0};
+	SearchInfos search;
+	SearchThread * th = search_newThread();
+	Move * moves = malloc(GAME_MAX_MOVES * sizeof(Move));
+	RootLine * lines = malloc((GAME_MAX_MOVES + 1) * sizeof(RootLine));
+	Position * saved = malloc(sizeof(Position));
+	char * text = NULL;
+	FILE * file;
+	U64 start = GET_TIME();
+
+	init();
+
+	if (!th || !moves || !lines || !saved) {
+		printf("info string out of memory\n");
+		goto end;
+	}
+
+	memset(&limits, 0, sizeof(limits));
+
+	/* Limits first, then the PGN file or the moves */
+	while (sscanf(args + offset, "%255s%n", token, &read) == 1) {
+		long long value = 0;
+		int value_read = 0;
+
+		if (sscanf(args + offset + read, "%lld%n", &value, &value_read) != 1 || !readLimit(token, value)) break;
+
+		offset += read + value_read;
+	}
+
+	if (!limits.depth && !limits.nodes && !limits.movetime) {
+		limits.depth = DEFAULT_DEPTH;
+	}
+
+	args += offset + strspn(args + offset, " ");
+
+	file = fopen(args, "rb");
+	if (file) {
+		long size;
+
+		fseek(file, 0, SEEK_END);
+		size = ftell(file);
+		fseek(file, 0, SEEK_SET);
+
+		text = malloc(size + 1);
+		if (text) {
+			text[fread(text, 1, size, file)] = '\0';
+		}
+		fclose(file);
+	}
+
+	/* The position of the UCI thread is borrowed */
+	*saved = pos;
+
+	count = readGame(text ? text : args, moves, GAME_MAX_MOVES);
+
+	if (count < 0) goto restore;
+
+	/* Black moves are followed by an increment of the move number */
+	start_side = pos.side ^ (count & 1);
+	start_fullmove = pos.fullmove - (count + start_side) / 2;
+
+	mutex_lock(&lock);
+	aborted = 0;
+	game_search = &search;
+	mutex_unlock(&lock);
+
+	/*
+	From the last position to the first: the hash table filled by the
+	searches of the later positions guides the searches of the earlier ones
+	*/
+	for (first = count; first >= 0; first--) {
+		Move movelist[MAX_MOVES];
+		RootLine * line = &lines[first];
+
+		if (first < count) position_undoMove(&moves[first]);
+
+		mutex_lock(&lock);
+		search = limits;
+		search.stop = aborted;
+		mutex_unlock(&lock);
+
+		search.root = pos;
+		search_single(th, &search);
+
+		if (aborted) break;
+
+		line->depth = th->depth;
+		line->score = th->score;
+		line->pv_length = th->pv_length;
+		memcpy(line->pv, th->pv, line->pv_length * sizeof(Move));
+
+		/* Checkmate or stalemate */
+		if (!position_generateMoves(movelist)) {
+			line->score = pos.in_check ? -INFINITY : 0;
+			line->pv_length = 0;
+		}
+	}
+
+	mutex_lock(&lock);
+	game_search = NULL;
+	mutex_unlock(&lock);
+
+	first++;
+
+	/* The score of a move is the one of the position it leads to */
+	for (i = first; i < count; i++) {
+		RootLine * line = &lines[i];
+		int side = start_side ^ (i & 1);
+		int score = -lines[i + 1].score;
+		int is_best = line->pv_length && SAME_MOVE(line->pv[0], moves[i]);
+		int loss = is_best ? 0 : MAX(clampScore(line->score) - clampScore(score), 0);
+		char move[8], best[8];
+
+		if (is_best) score = line->score;
+
+		uci_format_move(move, &moves[i]);
+		if (line->pv_length) {
+			uci_format_move(best, &line->pv[0]);
+		} else {
+			strcpy(best, "none");
+		}
+
+		printf("move %d %s %s score %d best %s %d loss %d %s", start_fullmove + (i + start_side) / 2,
+		       side == WHITE ? "white" : "black", move, score, best, line->score, loss, classify(loss, is_best));
+
+		/* The best alternative */
+		if (!is_best) {
+			printf(" pv");
+			for (j=0; j < line->pv_length; j++) {
+				uci_format_move(best, &line->pv[j]);
+				printf(" %s", best);
+			}
+		}
+		printf("\n");
+
+		played[side]++;
+		loss_sum[side] += loss;
+		if (!is_best && loss >= INACCURACY_LOSS) {
+			errors[side][loss >= BLUNDER_LOSS ? 2 : (loss >= MISTAKE_LOSS ? 1 : 0)]++;
+		}
+	}
+
+	for (i=0; i < 2; i++) {
+		printf("summary %s average loss %ld inaccuracies %d mistakes %d blunders %d\n", i == WHITE ? "white" : "black",
+		       played[i] ? loss_sum[i] / played[i] : 0, errors[i][0], errors[i][1], errors[i][2]);
+	}
+
+	printf("info string analyzed %d positions in %llu ms%s\n", count - first + 1, ULL(GET_TIME() - start),
+	       aborted ? ", interrupted" : "");
+
+restore:
+	pos = *saved;
+
+end:
+	search_freeThread(th);
+	free(moves);
+	free(lines);
+	free(saved);
+	free(text);
+}
@@ -0,0 +1,49 @@
+/**
+* Byak, a UCI chess engine.
+* Copyright (C) 2013  Sylvain Philip
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef ANALYZE_H
+#define ANALYZE_H
+
+/*
+Batch analysis of an EPD file (analyze command). The positions are
+searched by a pool of workers, each running its own single threaded
+search, and the results are written in the order of the file:
+
+fen; bestmove; score; pv
+
+Only complete records are written, the number of records written is the
+index to resume from.
+*/
+
+/* analyze <epd-file> [depth x] [nodes x] [movetime x] [threads x] [resume x] [output <file>] */
+void analyze_run(const char * args);
+/*
+analysegame [depth x] [nodes x] [movetime x] <pgn-file | moves>
+
+Search the positions of a game from the last one to the first, so that each
+search benefits from the hash table entries of the later positions. The
+moves are written in SAN or coordinate notation. Each move is reported
+with its score, the best move and its score, the score lost and the
+classification of the move, and the line of the best move when another
+move was played.
+*/
+void analyze_game(const char * args);
+/* Abort a running analysis, called by the input thread on stop and quit */
+void analyze_stop();
+
+#endif
@@ -21,6 +21,7 @@
 #include <string.h>
 #include "bitboard.h"
 #include "magicmoves.h"
+#include "memory.h"
 
 /** Algebric notation for each square */
 static char bin2alg[64][3];
@@ -230,6 +231,13 @@ void bitboard_init()
 	gen_diag_ne();
 	gen_diag_nw();
 	gen_obstructed();
+	/*
+	The rook table is probed on every slider attack generation. Advise the
+	kernel before the first write so the table is faulted in as a huge page.
+	*/
+	#if !defined(MINIMIZE_MAGIC) && !defined(PERFECT_MAGIC_HASH)
+	memory_adviseHuge(magicmovesrdb, sizeof(magicmovesrdb));
+	#endif
 	/* Init the magic moves generator for the all the application */
 	initmagicmoves();
 }
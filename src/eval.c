@@ -16,11 +16,35 @@
 * along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <stdio.h>
 #include "bitboard.h"
 #include "eval.h"
 #include "position.h"
 #include "move.h"
 
+const int eval_pieceValue[NONE_PIECE + 1] = {
+	100, 100, // P p
+	  0,   0, // K k
+	900, 900, // Q q
+	300, 300, // N n
+	300, 300, // B b
+	600, 600, // R r
+	  0       // NONE_PIECE
+};
+
+const int eval_phase[NONE_PIECE + 1] = {
+	0, 0, // P p
+	0, 0, // K k
+	4, 4, // Q q
+	1, 1, // N n
+	1, 1, // B b
+	2, 2, // R r
+	0     // NONE_PIECE
+};
+
+int eval_psqMg[NONE_PIECE][64];
+int eval_psqEg[NONE_PIECE][64];
+
 static const Eval w_opening[] = {
 	// {RANK7                  , -60 , P },
 	// {RANK6                  , -20 , P },
@@ -55,8 +79,6 @@ static const Eval w_opening[] = {
 	{(FILED|FILEF|RANK2)    , -40 , K }, 
 };
 
-static Eval b_opening[sizeof(w_opening) / sizeof(Eval)];
-
 static const Eval w_middlegame[] = {
 	{RANK7                  , -40 , P },
 	{RANK6                  , -20 , P },
@@ -89,8 +111,6 @@ static const Eval w_middlegame[] = {
 	{(FILED|FILEF|RANK2|FILEE),-100, K }, 
 };
 
-static Eval b_middlegame[sizeof(w_middlegame) / sizeof(Eval)];
-
 static const Eval w_endgame[] = {
 	{RANK7                  ,  80 , P },
 	{RANK6                  ,  60 , P },
@@ -119,20 +139,48 @@ static const Eval w_endgame[] = {
 	{RANK1                  ,-30 , K },
 };
 
-static Eval b_endgame[sizeof(w_endgame) / sizeof(Eval)];
-
+/* Add the score of each entry of a table to the squares it covers, for the white pieces */
+static void addTable(int psq[NONE_PIECE][64], const Eval * table, int length)
+{
+	int i;
+	U64 mask;
+	Square square;
+
+	for (i=0; i < length; i++) {
+		mask = table[i].mask;
+		while (mask) {
+			square = bitboard_poplsb(&mask);
+			psq[table[i].piece][square] += table[i].score;
+		}
+	}
+}
 
+/*
+The opening entries are part of the middlegame tables, they fade out with the
+pieces like the middlegame ones. The black tables are the white ones
+mirrored vertically and negated, the scores being from white's point of view.
+*/
 void eval_init()
 {
-	U32 i;
+	int piece, sq;
 
-	for (i=0; i < sizeof(w_opening) / sizeof(Eval); i++) {
-		b_opening[i].mask  = bitboard_swap(w_opening[i].mask);
-		b_opening[i].score = w_opening[i].score;
-		b_opening[i].piece = w_opening[i].piece + 1;
+	for (piece=P; piece < NONE_PIECE; piece += 2) {
+		for (sq=0; sq < 64; sq++) {
+			eval_psqMg[piece][sq] = eval_psqEg[piece][sq] = eval_pieceValue[piece];
+		}
 	}
-}
 
+	addTable(eval_psqMg, w_opening, sizeof(w_opening) / sizeof(Eval));
+	addTable(eval_psqMg, w_middlegame, sizeof(w_middlegame) / sizeof(Eval));
+	addTable(eval_psqEg, w_endgame, sizeof(w_endgame) / sizeof(Eval));
+
+	for (piece=P; piece < NONE_PIECE; piece += 2) {
+		for (sq=0; sq < 64; sq++) {
+			eval_psqMg[piece + 1][sq ^ 56] = -eval_psqMg[piece][sq];
+			eval_psqEg[piece + 1][sq ^ 56] = -eval_psqEg[piece][sq];
+		}
+	}
+}
 
 int eval_position()
 {
@@ -147,74 +195,137 @@ int eval_position()
 	int who2move = (pos.side == WHITE) ? 1 : -1;
 
 	if (pos.checkmated) {
-		return INFINITY * who2move;
+		/* The side to move is mated */
+		return -INFINITY;
 	}
 
-	int score = 0; // Material evaluation in centipawn
+	/* Blend of the sums kept by the position, see EVAL_PHASE_MAX */
+	int phase = MIN(pos.phase, EVAL_PHASE_MAX);
+	int score = (pos.psq_mg * phase + pos.psq_eg * (EVAL_PHASE_MAX - phase)) / EVAL_PHASE_MAX;
 
-	int popCnt[NONE_PIECE] = {0};
-	int i, popCntTotal = 0;
-	// Stage stage;
-	U64 bb_pieces;
+	/* Todo : 
+	- Minor Piece activity (good bishop vs bad bishop, knight outpost...)
+	- Rooks controlling open files
+	- pawn structure check
+	*/
 
-	for (i=P ; i < NONE_PIECE ; i++) {
-		popCntTotal += popCnt[i] = bitboard_popCount(pos.bb_pieces[i]);
-	}
+	return score * who2move;
+}
 
-	score += 100 * (popCnt[P] - popCnt[p]);
-	score += 900 * (popCnt[Q] - popCnt[q]);
-	score += 300 * (popCnt[N] - popCnt[n]);
-	score += 300 * (popCnt[B] - popCnt[b]);
-	score += 600 * (popCnt[R] - popCnt[r]);
-
-	// Try to determine if we are in the opening, the middle game or the endgame
-	if (pos.castling_rights && (popCntTotal - (popCnt[P] + popCnt[p])) > 10) {
-		// Opening
-		for (i=0; i < sizeof(w_opening) / sizeof(Eval); i++) {
-			bb_pieces = pos.bb_pieces[w_opening[i].piece];
-			if (w_opening[i].mask & bb_pieces) {
-				score += bitboard_popCount(w_opening[i].mask & bb_pieces) * w_opening[i].score;
-			}
-			bb_pieces = pos.bb_pieces[b_opening[i].piece];
-			if (b_opening[i].mask & bb_pieces) {
-				score -= bitboard_popCount(b_opening[i].mask & bb_pieces) * b_opening[i].score;
-			}
-		}
-	} 
-	else if ((popCntTotal - (popCnt[P] + popCnt[p])) < 7) {
-		// Engame
-		for (i=0; i < sizeof(w_endgame) / sizeof(Eval); i++) {
-			bb_pieces = pos.bb_pieces[w_endgame[i].piece];
-			if (w_endgame[i].mask & bb_pieces) {
-				score += bitboard_popCount(w_endgame[i].mask & bb_pieces) * w_endgame[i].score;
-			}
-			bb_pieces = pos.bb_pieces[b_endgame[i].piece];
-			if (b_endgame[i].mask & bb_pieces) {
-				score -= bitboard_popCount(b_endgame[i].mask & bb_pieces) * b_endgame[i].score;
-			}
+/*
+Tuning. The weights are the material values of the pieces other than the
+king, followed by the scores of the opening, middlegame and endgame tables. The
+features are scaled by the phase so that the weighted sum is the numerator
+of the blend of eval_position().
+*/
+static const Piece tunedPieces[] = {P, Q, N, B, R};
+
+#define MATERIAL_WEIGHTS  (sizeof(tunedPieces) / sizeof(Piece))
+#define OPENING_WEIGHTS   (sizeof(w_opening) / sizeof(Eval))
+#define MIDDLEGAME_WEIGHTS (sizeof(w_middlegame) / sizeof(Eval))
+#define ENDGAME_WEIGHTS   (sizeof(w_endgame) / sizeof(Eval))
+
+_Static_assert(MATERIAL_WEIGHTS + OPENING_WEIGHTS + MIDDLEGAME_WEIGHTS + ENDGAME_WEIGHTS <= EVAL_MAX_WEIGHTS,
+               "EVAL_MAX_WEIGHTS is too small");
+
+int eval_weights(int * weights)
+{
+	int count = 0;
+	U32 i;
+
+	for (i=0; i < MATERIAL_WEIGHTS; i++) weights[count++] = eval_pieceValue[tunedPieces[i]];
+	for (i=0; i < OPENING_WEIGHTS; i++) weights[count++] = w_opening[i].score;
+	for (i=0; i < MIDDLEGAME_WEIGHTS; i++) weights[count++] = w_middlegame[i].score;
+	for (i=0; i < ENDGAME_WEIGHTS; i++) weights[count++] = w_endgame[i].score;
+
+	return count;
+}
+
+/*
+Features of the entries of a table, first is the index of the weight of the
+first entry. Black pieces are counted on the mirrored mask.
+*/
+static int tableFeatures(EvalFeature * features, int count, const Eval * table, int length,
+                         int first, int scale)
+{
+	int i, value;
+
+	for (i=0; i < length; i++) {
+		value = bitboard_popCount(table[i].mask & pos.bb_pieces[table[i].piece])
+		      - bitboard_popCount(bitboard_swap(table[i].mask) & pos.bb_pieces[table[i].piece + 1]);
+
+		if (value && scale) {
+			features[count].index = first + i;
+			features[count].value = value * scale;
+			count++;
 		}
 	}
-	else {
-		// Midlegame
-		for (i=0; i < sizeof(w_middlegame) / sizeof(Eval); i++) {
-			bb_pieces = pos.bb_pieces[w_middlegame[i].piece];
-			if (w_middlegame[i].mask & bb_pieces) {
-				score += bitboard_popCount(w_middlegame[i].mask & bb_pieces) * w_middlegame[i].score;
-			}
-			bb_pieces = pos.bb_pieces[b_middlegame[i].piece];
-			if (b_middlegame[i].mask & bb_pieces) {
-				score -= bitboard_popCount(b_middlegame[i].mask & bb_pieces) * b_middlegame[i].score;
-			}
+
+	return count;
+}
+
+int eval_features(EvalFeature * features)
+{
+	int phase = MIN(pos.phase, EVAL_PHASE_MAX);
+	int count = 0, value;
+	U32 i;
+
+	for (i=0; i < MATERIAL_WEIGHTS; i++) {
+		value = bitboard_popCount(pos.bb_pieces[tunedPieces[i]])
+		      - bitboard_popCount(pos.bb_pieces[tunedPieces[i] + 1]);
+
+		if (value) {
+			features[count].index = i;
+			features[count].value = value * EVAL_PHASE_MAX;
+			count++;
 		}
 	}
 
-	/* Todo : 
-	- Minor Piece activity (good bishop vs bad bishop, knight outpost...)
-	- Rooks controlling open files
-	- pawn structure check
-	*/
+	count = tableFeatures(features, count, w_opening, OPENING_WEIGHTS,
+	                      MATERIAL_WEIGHTS, phase);
+	count = tableFeatures(features, count, w_middlegame, MIDDLEGAME_WEIGHTS,
+	                      MATERIAL_WEIGHTS + OPENING_WEIGHTS, phase);
+	count = tableFeatures(features, count, w_endgame, ENDGAME_WEIGHTS,
+	                      MATERIAL_WEIGHTS + OPENING_WEIGHTS + MIDDLEGAME_WEIGHTS, EVAL_PHASE_MAX - phase);
 
-	return score * who2move;
+	return count;
+}
+
+static void printTable(FILE * file, const char * name, const Eval * table, int length, const int * weights)
+{
+	static const char pieces[] = "PpKkQqNnBbRr";
+	int i;
+
+	fprintf(file, "static const Eval %s[] = {\n", name);
+	for (i=0; i < length; i++) {
+		fprintf(file, "\t{C64(0x%016llx), %4d , %c },\n", ULL(table[i].mask), weights[i], pieces[table[i].piece]);
+	}
+	fprintf(file, "};\n\n");
+}
+
+void eval_printWeights(FILE * file, const int * weights)
+{
+	U32 i;
+
+	static const char * names[] = {"P p", "K k", "Q q", "N n", "B b", "R r"};
+	int values[NONE_PIECE] = {0};
+
+	for (i=0; i < MATERIAL_WEIGHTS; i++) {
+		values[tunedPieces[i]] = weights[i];
+	}
+
+	fprintf(file, "const int eval_pieceValue[NONE_PIECE + 1] = {\n");
+	for (i=P; i < NONE_PIECE; i += 2) {
+		fprintf(file, "\t%4d, %4d, // %s\n", values[i], values[i], names[i / 2]);
+	}
+	fprintf(file, "\t   0       // NONE_PIECE\n};\n\n");
+
+	weights += MATERIAL_WEIGHTS;
+	printTable(file, "w_opening", w_opening, OPENING_WEIGHTS, weights);
+	weights += OPENING_WEIGHTS;
+	printTable(file, "w_middlegame", w_middlegame, MIDDLEGAME_WEIGHTS, weights);
+	weights += MIDDLEGAME_WEIGHTS;
+	printTable(file, "w_endgame", w_endgame, ENDGAME_WEIGHTS, weights);
 }
 
 int eval_move(Move * move)
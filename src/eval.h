@@ -19,17 +19,14 @@
 #ifndef EVAL_H
 #define EVAL_H
 
+#include <stdio.h>
 #include "types.h"
 #include "move.h"
 
+/* The score bound, not the float infinity of math.h */
+#undef INFINITY
 #define INFINITY 10000
 
-typedef enum enumStage {
-	OPENING,
-	MIDDLEGAME,
-	ENDGAME,
-} Stage;
-
 /*16 Bytes */
 typedef struct {
 	U64 mask;
@@ -37,6 +34,49 @@ typedef struct {
 	Piece piece;
 } Eval;
 
+/* Material value in centipawns of each piece, indexed by Piece */
+extern const int eval_pieceValue[NONE_PIECE + 1];
+
+/*
+Tapered evaluation: the phase of a position is the sum of the eval_phase of
+its pieces, EVAL_PHASE_MAX with all the pieces on the board (more after
+promotions, counted as EVAL_PHASE_MAX) and 0 with only kings and pawns.
+The middlegame score counts for phase / EVAL_PHASE_MAX, the endgame score
+for the rest.
+*/
+#define EVAL_PHASE_MAX 24
+
+extern const int eval_phase[NONE_PIECE + 1];
+
+/*
+Piece-square tables, from white's point of view: the material value of the
+piece plus the scores of the opening and middlegame entries, or of the
+endgame entries, covering the square. Compiled by eval_init(), the position
+keeps their sums up to date.
+*/
+extern int eval_psqMg[NONE_PIECE][64];
+extern int eval_psqEg[NONE_PIECE][64];
+
+/*
+Tuning (see tune.c): from white's point of view, the evaluation of a
+position is the sum of its features weighted by the weights of the
+evaluation, divided by EVAL_PHASE_MAX. Only the features which are not
+zero are given.
+*/
+#define EVAL_MAX_WEIGHTS 256
+
+typedef struct {
+	U16 index; // Weight of the feature
+	S16 value; // Scaled by the phase
+} EvalFeature;
+
+/* Current weights, returns their count */
+int eval_weights(int * weights);
+/* Features of the current position, room for EVAL_MAX_WEIGHTS, returns their count */
+int eval_features(EvalFeature * features);
+/* Write tables of the given weights, in the layout of the source */
+void eval_printWeights(FILE * file, const int * weights);
+
 void eval_init();
 int eval_position();
 int eval_move(Move * move);
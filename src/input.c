@@ -0,0 +1,117 @@
+/**
+* Byak, a UCI chess engine.
+* Copyright (C) 2013  Sylvain Philip
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "input.h"
+#include "thread.h"
+#include "uci.h"
+
+/* Long enough for the position command of a long game */
+#define MAX_INPUT_SIZE 65536
+
+/* Commands waiting for the main thread */
+#define QUEUE_SIZE 256
+
+static char * queue[QUEUE_SIZE];
+static int queue_head = 0;
+static int queue_count = 0;
+static Mutex queue_lock;
+static Cond queue_changed;
+static Thread reader;
+
+static char * duplicate(const char * string)
+{
+	size_t length = strlen(string) + 1;
+	char * copy = malloc(length);
+
+	if (copy) memcpy(copy, string, length);
+
+	return copy;
+}
+
+static void push(const char * command)
+{
+	char * copy = duplicate(command);
+
+	if (!copy) return;
+
+	mutex_lock(&queue_lock);
+	while (queue_count == QUEUE_SIZE) {
+		cond_wait(&queue_changed, &queue_lock);
+	}
+	queue[(queue_head + queue_count) % QUEUE_SIZE] = copy;
+	queue_count++;
+	cond_broadcast(&queue_changed);
+	mutex_unlock(&queue_lock);
+}
+
+static void* input_loop(void* data)
+{
+	static char input[MAX_INPUT_SIZE];
+	size_t length;
+
+	while (fgets(input, MAX_INPUT_SIZE, stdin) != NULL) {
+
+		/* Remove the newline character(s) */
+		length = strlen(input);
+		while (length && (input[length - 1] == '\n' || input[length - 1] == '\r')) {
+			input[--length] = '\0';
+		}
+
+		uci_signal(input);
+		push(input);
+
+		if (!strcmp(input, "quit")) return NULL;
+	}
+
+	/* The GUI is gone */
+	uci_signal("quit");
+	push("quit");
+
+	return NULL;
+}
+
+void input_init()
+{
+	mutex_init(&queue_lock);
+	cond_init(&queue_changed);
+
+	if (!thread_create(&reader, input_loop, NULL)) {
+		printf("Input thread not created\n");
+		exit(1);
+	}
+}
+
+char * input_pop()
+{
+	char * command;
+
+	mutex_lock(&queue_lock);
+	while (!queue_count) {
+		cond_wait(&queue_changed, &queue_lock);
+	}
+	command = queue[queue_head];
+	queue_head = (queue_head + 1) % QUEUE_SIZE;
+	queue_count--;
+	cond_broadcast(&queue_changed);
+	mutex_unlock(&queue_lock);
+
+	return command;
+}
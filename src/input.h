@@ -0,0 +1,38 @@
+/**
+* Byak, a UCI chess engine.
+* Copyright (C) 2013  Sylvain Philip
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef INPUT_H
+#define INPUT_H
+
+/*
+The standard input is read by a dedicated thread. The commands are queued
+for the main thread, which may be busy waiting for a search to end, while
+the time critical ones (see uci_signal()) take effect right away.
+*/
+
+/* Start the input thread */
+void input_init();
+
+/**
+ * Next command, blocking until one is available
+ * @return the command, to be freed by the caller. "quit" is returned
+ * when the standard input is closed.
+ */
+char * input_pop();
+
+#endif
@@ -28,6 +28,7 @@
  */
 
 #include "magicmoves.h"
+#include "memory.h"
 
 #ifdef _MSC_VER
 	#pragma message("MSC compatible compiler detected -- turning off warning 4312,4146")
@@ -207,7 +208,8 @@ const U64* magicmoves_r_indices[64]=
 };
 #else
 	#ifndef PERFECT_MAGIC_HASH
-		U64 magicmovesrdb[64][1<<12];
+		/* Byak: aligned so that the 2 MB rook table fits a single huge page */
+		U64 magicmovesrdb[64][1<<12] HUGE_PAGE_ALIGN;
 	#else
 		U64 magicmovesrdb[4900];
 		PERFECT_MAGIC_HASH magicmoves_r_indices[64][1<<12];
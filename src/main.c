@@ -25,9 +25,9 @@
 #include "eval.h"
 #include "prng.h"
 #include "tt.h"
+#include "search.h"
 #include "uci.h"
-
-#define MAX_INPUT_SIZE 1024
+#include "input.h"
 
 int main (int argc, char ** argv) {
 
@@ -37,28 +37,25 @@ int main (int argc, char ** argv) {
 	tt_init(144000000);
 	position_init();
 	eval_init();
+	search_init();
 
 	printf("Chess Engine By Sylvain Philip\n");
+	tt_print_info();
 
-	/* deactivate buffering */
-	setvbuf(stdin,  NULL, _IONBF, 0);
-	setvbuf(stdout, NULL, _IONBF, 0);
+	/*
+	Full buffering, the output of a command is flushed once it has been
+	executed, and the search flushes each line it prints (see uci_send())
+	*/
+	fflush(stdout);
+	setvbuf(stdout, NULL, _IOFBF, BUFSIZ);
 
-	char input[MAX_INPUT_SIZE];
+	input_init();
 
 	while(1) {
-		
-		if (fgets(input, MAX_INPUT_SIZE, stdin) != NULL) {
-
-			/* Remove the newline character */
-			int s = strlen(input);
-
-			if (s > 1 && input[s-1] == '\n') {
-				input[s-1] = '\0';
-			}
-
-			uci_exec(input);
-		}
+		char * command = input_pop();
+		uci_exec(command);
+		free(command);
+		fflush(stdout);
 	}
 
 	return 0;
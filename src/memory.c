@@ -0,0 +1,127 @@
+/**
+* Byak, a UCI chess engine.
+* Copyright (C) 2013  Sylvain Philip
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#if defined(__linux__)
+/* MAP_ANONYMOUS, MAP_HUGETLB and MADV_HUGEPAGE are not part of C11 */
+#define _GNU_SOURCE
+#include <sys/mman.h>
+#endif
+
+#include <stdint.h>
+#include <stdlib.h>
+#include "memory.h"
+
+static size_t roundToHugePage(size_t size)
+{
+	return (size + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+}
+
+/*
+Touch every page now. Faulting a transparent huge page may trigger a
+synchronous compaction, this cost must not be paid during the search.
+*/
+static void prefault(char *ptr, size_t size)
+{
+	size_t offset;
+
+	for (offset = 0; offset < size; offset += 4096) {
+		ptr[offset] = 0;
+	}
+}
+
+void * memory_allocLarge(size_t size, PageType *type)
+{
+#if defined(__linux__)
+	size_t huge_size = roundToHugePage(size);
+	void *ptr;
+
+	/*
+	First try explicit huge pages. This only succeeds when the administrator
+	has reserved enough pages (/proc/sys/vm/nr_hugepages).
+	*/
+	#ifdef MAP_HUGETLB
+	ptr = mmap(NULL, huge_size, PROT_READ | PROT_WRITE,
+	           MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+
+	if (ptr != MAP_FAILED) {
+		*type = PAGE_HUGETLB;
+		return ptr;
+	}
+	#endif
+
+	/*
+	Then an anonymous mapping aligned on a huge page boundary so that the
+	kernel can promote it to transparent huge pages. We map one extra huge page
+	and unmap the unaligned head and tail.
+	*/
+	char *raw = mmap(NULL, huge_size + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE,
+	                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+	if (raw != MAP_FAILED) {
+		char *aligned = (char *) roundToHugePage((uintptr_t) raw);
+		size_t head = aligned - raw;
+		size_t tail = HUGE_PAGE_SIZE - head;
+
+		if (head) munmap(raw, head);
+		if (tail) munmap(aligned + huge_size, tail);
+
+		*type = memory_adviseHuge(aligned, huge_size) ? PAGE_TRANSPARENT : PAGE_MAPPED;
+		prefault(aligned, huge_size);
+		return aligned;
+	}
+#endif
+
+	*type = PAGE_DEFAULT;
+	return calloc(1, size);
+}
+
+void memory_freeLarge(void *ptr, size_t size, PageType type)
+{
+	if (ptr == NULL) return;
+
+#if defined(__linux__)
+	if (type != PAGE_DEFAULT) {
+		munmap(ptr, roundToHugePage(size));
+		return;
+	}
+#endif
+	free(ptr);
+}
+
+int memory_adviseHuge(void *ptr, size_t size)
+{
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+	return madvise(ptr, size, MADV_HUGEPAGE) == 0;
+#else
+	return 0;
+#endif
+}
+
+size_t memory_pageSize(PageType type)
+{
+	return (type == PAGE_DEFAULT || type == PAGE_MAPPED) ? 4096 : HUGE_PAGE_SIZE;
+}
+
+const char * memory_pageName(PageType type)
+{
+	switch (type) {
+		case PAGE_HUGETLB: return "huge pages";
+		case PAGE_TRANSPARENT: return "transparent huge pages";
+		default: return "default pages";
+	}
+}
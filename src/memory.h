@@ -0,0 +1,73 @@
+/**
+* Byak, a UCI chess engine.
+* Copyright (C) 2013  Sylvain Philip
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef MEMORY_H
+#define MEMORY_H
+
+#include <stddef.h>
+
+/* 2 MB, the huge page size on x86-64 Linux */
+#define HUGE_PAGE_SIZE ((size_t) 2 * 1024 * 1024)
+
+#if defined(__linux__)
+	/* Static tables aligned on this boundary can be backed by a transparent huge page */
+	#define HUGE_PAGE_ALIGN __attribute__((aligned(2 * 1024 * 1024)))
+#else
+	#define HUGE_PAGE_ALIGN
+#endif
+
+typedef enum enumPageType {
+	PAGE_DEFAULT,     // Memory obtained from malloc, no huge page
+	PAGE_MAPPED,      // Anonymous mapping for which the huge page advice was refused
+	PAGE_TRANSPARENT, // Anonymous mapping advised for transparent huge pages
+	PAGE_HUGETLB      // Explicit huge pages reserved from the hugetlbfs pool
+} PageType;
+
+/**
+ * Allocate a large zeroed block, backed by huge pages when the system allows it.
+ * The requested size is rounded up to a multiple of HUGE_PAGE_SIZE when huge
+ * pages are used.
+ * @param size the block size in bytes
+ * @param type receives the kind of pages backing the block
+ * @return the block or NULL if the memory can't be allocated
+ */
+void * memory_allocLarge(size_t size, PageType *type);
+
+/**
+ * Release a block obtained with memory_allocLarge()
+ */
+void memory_freeLarge(void *ptr, size_t size, PageType type);
+
+/**
+ * Ask the kernel to back an existing memory range with transparent huge pages.
+ * The range should start on a HUGE_PAGE_SIZE boundary (see HUGE_PAGE_ALIGN).
+ * @return 1 if the advice was accepted, 0 otherwise
+ */
+int memory_adviseHuge(void *ptr, size_t size);
+
+/**
+ * Page size in bytes of the given page type
+ */
+size_t memory_pageSize(PageType type);
+
+/**
+ * Human readable name of the given page type
+ */
+const char * memory_pageName(PageType type);
+
+#endif
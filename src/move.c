@@ -40,6 +40,12 @@ char move_getPromotionPieceChar(U8 flags)
 	return ' ';
 }
 
+U16 move_pack(Move *move)
+{
+	/* The four promotion flags fit in the upper bits */
+	return move->from | (move->to << 6) | ((move->flags & 0xF0) << 8);
+}
+
 void move_displayAlg(Move *move)
 {
 	printf("%s%c%s%c", bitboard_binToAlg(SQ64(move->from)),
@@ -39,7 +39,8 @@
 typedef struct {
 	// for search
 	/* 4 B */ unsigned int score;
-	/* 4 B */ unsigned int padding; // This is just to adjust the struct size to 16B
+	/* 2 B */ U16 halfmove; // Halfmove clock before the move, determined when making move
+	/* 2 B */ U16 padding; // This is just to adjust the struct size to 16B
 	/* 2 B */ U16 flags;
 	/* 1 B */ U8 from; // Square from
 	/* 1 B */ U8 to;   // Square to
@@ -48,7 +49,12 @@ typedef struct {
 	/* 1 B */ U8 castling_rights;
 } Move;
 
+/* Same squares and flags: the same move when both are moves of the same position */
+#define SAME_MOVE(a, b) ((a).from == (b).from && (a).to == (b).to && (a).flags == (b).flags)
+
 void move_display(Move *move);
+/* 16 bits identifier of the move: from, to and promotion piece. 0 is no move. */
+U16 move_pack(Move *move);
 void move_displayAlg(Move *move);
 char move_getPromotionPieceChar(U8 flags);
 #endif
@@ -27,19 +27,32 @@
 #include "position.h"
 #include "move.h"
 #include "tt.h"
+#include "eval.h"
 
 #define POS_ADD_PIECE(piece, sq) \
 	pos.bb_pieces[(piece)] |= SQ64((sq));\
-	pos.hash ^= zobrist.piecesquare[(piece)][(sq)]
+	pos.board[(sq)] = (piece);\
+	pos.hash ^= zobrist.piecesquare[(piece)][(sq)];\
+	pos.psq_mg += eval_psqMg[(piece)][(sq)];\
+	pos.psq_eg += eval_psqEg[(piece)][(sq)];\
+	pos.phase += eval_phase[(piece)]
 
 #define POS_DEL_PIECE(piece, sq) \
 	pos.bb_pieces[(piece)] ^= SQ64((sq));\
-	pos.hash ^= zobrist.piecesquare[(piece)][(sq)]
+	pos.board[(sq)] = NONE_PIECE;\
+	pos.hash ^= zobrist.piecesquare[(piece)][(sq)];\
+	pos.psq_mg -= eval_psqMg[(piece)][(sq)];\
+	pos.psq_eg -= eval_psqEg[(piece)][(sq)];\
+	pos.phase -= eval_phase[(piece)]
 
 #define POS_MOVE_PIECE(piece, sq_from, sq_to) \
 	pos.bb_pieces[(piece)] ^=  SQ64((sq_from)) ^ SQ64((sq_to)); \
+	pos.board[(sq_from)] = NONE_PIECE; \
+	pos.board[(sq_to)] = (piece); \
 	pos.hash ^= zobrist.piecesquare[(piece)][(sq_from)]; \
-	pos.hash ^= zobrist.piecesquare[(piece)][(sq_to)];
+	pos.hash ^= zobrist.piecesquare[(piece)][(sq_to)]; \
+	pos.psq_mg += eval_psqMg[(piece)][(sq_to)] - eval_psqMg[(piece)][(sq_from)]; \
+	pos.psq_eg += eval_psqEg[(piece)][(sq_to)] - eval_psqEg[(piece)][(sq_from)];
 
 #define OUR_SIDE pos.side
 #define OTHER_SIDE (1 ^ pos.side)
@@ -72,9 +85,9 @@
 #define B_ROCK_OCCUPIED_KS ((SQ64(g8) | SQ64(f8)) & pos.bb_occupied)
 #define B_ROCK_OCCUPIED_QS ((SQ64(b8) | SQ64(c8) | SQ64(d8)) & pos.bb_occupied)
 
-Position pos;
+_Thread_local Position pos;
 
-static int movelistcount;
+static _Thread_local int movelistcount;
 
 inline FORCE_INLINE static void position_refresh()
 {
@@ -512,6 +525,7 @@ static void genCheckEvasions(Move *movelist)
 void position_init()
 {
 	memset(pos.bb_pieces, 0, sizeof(pos.bb_pieces));
+	memset(pos.board, NONE_PIECE, sizeof(pos.board));
 
 	pos.bb_side[WHITE] = EMPTY;
 	pos.bb_side[BLACK] = EMPTY;
@@ -532,6 +546,12 @@ void position_init()
 	memset(pos.pinner, 0, sizeof(pos.pinner));
 
 	pos.hash = EMPTY;
+	pos.psq_mg = 0;
+	pos.psq_eg = 0;
+	pos.phase = 0;
+	pos.halfmove = 0;
+	pos.fullmove = 1;
+	pos.history_count = 0;
 	movelistcount=0;
 }
 
@@ -602,6 +622,7 @@ int position_fromFen(const char *fen)
 	int i = 0, part = 0, rankIndex = 7, fileIndex = 0, squareIndex = 0;
 	U64 enPassantTarget = EMPTY;
 	U64 last_double = EMPTY;
+	int halfmove = 0, fullmove = 0;
 
 	for (i=0; i < length; i++) {
 
@@ -644,7 +665,8 @@ int position_fromFen(const char *fen)
 				break;
 			case 1:
 				pos.side = (fen[i] == 'w') ? WHITE : BLACK;
-				pos.hash ^= zobrist.side;
+				/* Same keys as the ones of position_makeMove() */
+				if (pos.side == BLACK) pos.hash ^= zobrist.side;
 				break;
 			case 2:
 				switch(fen[i]) {
@@ -661,7 +683,6 @@ int position_fromFen(const char *fen)
 						pos.castling_rights |= B_CASTLE_Q;
 						break;
 				}
-				pos.hash ^= zobrist.castling[pos.castling_rights];
 				break;
 			case 3:
 				if (pos.enpassant != NONE_SQUARE) {
@@ -680,33 +701,108 @@ int position_fromFen(const char *fen)
 					pos.hash ^= zobrist.ep[pos.enpassant];
 				}
 				break;
+			case 4:
+				if (fen[i] >= '0' && fen[i] <= '9') halfmove = halfmove * 10 + fen[i] - '0';
+				break;
+			case 5:
+				if (fen[i] >= '0' && fen[i] <= '9') fullmove = fullmove * 10 + fen[i] - '0';
+				break;
 		}
 
 	}
+
+	pos.hash ^= zobrist.castling[pos.castling_rights];
+
+	/* The clocks are optional */
+	pos.halfmove = halfmove;
+	if (fullmove) pos.fullmove = fullmove;
+
 	position_refresh();
 
 	return 0;
 }
 
+void position_toFen(char *fen)
+{
+	static const char pieces[] = "PpKkQqNnBbRr";
+	int rank, file, empty;
+
+	for (rank = 7; rank >= 0; rank--) {
+		empty = 0;
+
+		for (file = 0; file < 8; file++) {
+			Piece piece = pos.board[rank * 8 + file];
+
+			if (piece == NONE_PIECE) {
+				empty++;
+				continue;
+			}
+
+			if (empty) *fen++ = '0' + empty;
+			*fen++ = pieces[piece];
+			empty = 0;
+		}
+
+		if (empty) *fen++ = '0' + empty;
+		if (rank) *fen++ = '/';
+	}
+
+	*fen++ = ' ';
+	*fen++ = (pos.side == WHITE) ? 'w' : 'b';
+	*fen++ = ' ';
+
+	if (!pos.castling_rights) *fen++ = '-';
+	if (pos.castling_rights & W_CASTLE_K) *fen++ = 'K';
+	if (pos.castling_rights & W_CASTLE_Q) *fen++ = 'Q';
+	if (pos.castling_rights & B_CASTLE_K) *fen++ = 'k';
+	if (pos.castling_rights & B_CASTLE_Q) *fen++ = 'q';
+
+	sprintf(fen, " %s %d %d", (pos.enpassant == NONE_SQUARE) ? "-" : bitboard_binToAlg(SQ64(pos.enpassant)),
+	        pos.halfmove, pos.fullmove);
+}
+
+void position_addPiece(Piece piece, Square sq)
+{
+	POS_ADD_PIECE(piece, sq);
+}
+
+void position_setState(int side, int castling_rights, Square enpassant, int halfmove, int fullmove)
+{
+	pos.side = side;
+	pos.castling_rights = castling_rights;
+	pos.enpassant = enpassant;
+	pos.halfmove = halfmove;
+	pos.fullmove = fullmove;
+
+	if (side == BLACK) pos.hash ^= zobrist.side;
+	pos.hash ^= zobrist.castling[castling_rights];
+	if (enpassant != NONE_SQUARE) pos.hash ^= zobrist.ep[enpassant];
+
+	position_refresh();
+}
+
 void position_makeMove(Move *move)
 {
-	U64 bb_from   = SQ64(move->from);
 	U64 bb_to     = SQ64(move->to);
-	Piece pieceFrom = NONE_PIECE;
-	int i = 0;
-	move->captured_piece = NONE_PIECE;
+	Piece pieceFrom = pos.board[move->from];
+	move->captured_piece = pos.board[move->to];
 	move->ep = NONE_SQUARE;
 	move->castling_rights = pos.castling_rights;
+	move->halfmove = pos.halfmove;
 
-	/* Determine which piece type to move */
-	Piece piece[12] = {P,K,Q,N,B,R,p,k,q,n,b,r};
-	for (i=0; i < 12; i++) {
-		if (pos.bb_pieces[piece[i]] & bb_from) pieceFrom = piece[i];
-		if (pos.bb_pieces[piece[i]] & bb_to) move->captured_piece = piece[i];
+	if (pos.history_count < POSITION_HISTORY) {
+		pos.history[pos.history_count] = pos.hash;
 	}
+	pos.history_count++;
 
-	/* Move the piece */
-	POS_MOVE_PIECE(pieceFrom, move->from, move->to);
+	/* Captures and pawn moves are irreversible */
+	if ((move->flags & MOVE_CAPTURE) || pieceFrom == P + pos.side) {
+		pos.halfmove = 0;
+	} else {
+		pos.halfmove++;
+	}
+
+	if (pos.side == BLACK) pos.fullmove++;
 
 	if (pos.enpassant != NONE_SQUARE) {
 		/* 
@@ -733,6 +829,9 @@ void position_makeMove(Move *move)
 		}
 	}
 
+	/* Move the piece */
+	POS_MOVE_PIECE(pieceFrom, move->from, move->to);
+
 	/* 
 	*  castle flags
 	*  if either a king or a rook leaves its initial square, the side looses its castling-right.
@@ -819,22 +918,16 @@ void position_makeMove(Move *move)
 void position_undoMove(Move *move)
 {
 	U64 from_square = SQ64(move->to);
-	Piece piece[12] = {P,K,Q,N,B,R,p,k,q,n,b,r};
-	int i = 0;
-
-	Piece pieceFrom = NONE_PIECE;
+	Piece pieceFrom = pos.board[move->to];
 
 	pos.side = 1 ^ pos.side;
 	pos.hash ^= zobrist.side;
 
-	/* Determine which piece type to move */
-	for (i=0; i < 12; i++) {
-		if (pos.bb_pieces[piece[i]] & from_square) {
-			pieceFrom = piece[i];
-			POS_MOVE_PIECE(pieceFrom, move->to, move->from);
-			break;
-		}
-	}
+	pos.halfmove = move->halfmove;
+	pos.history_count--;
+	if (pos.side == BLACK) pos.fullmove--;
+
+	POS_MOVE_PIECE(pieceFrom, move->to, move->from);
 
 	if (pos.enpassant != NONE_SQUARE) {
 		// Deactivate En passant
@@ -905,7 +998,48 @@ void position_undoMove(Move *move)
 	position_refresh();
 }
 
-int position_generateMoves(Move *movelist)
+void position_makeNullMove(Move *move)
+{
+	move->flags = MOVE_NULL;
+	move->from = move->to = 0;
+	move->ep = pos.enpassant;
+	move->halfmove = pos.halfmove;
+
+	/* A repetition across a pass is meaningless, start a new sequence */
+	pos.halfmove = 0;
+
+	/* The en passant capture is no longer possible after a pass */
+	if (pos.enpassant != NONE_SQUARE) {
+		pos.hash ^= zobrist.ep[pos.enpassant];
+		pos.enpassant = NONE_SQUARE;
+	}
+
+	pos.side = 1 ^ pos.side;
+	pos.hash ^= zobrist.side;
+
+	position_refresh();
+}
+
+void position_undoNullMove(Move *move)
+{
+	pos.side = 1 ^ pos.side;
+	pos.hash ^= zobrist.side;
+	pos.halfmove = move->halfmove;
+
+	if (move->ep != NONE_SQUARE) {
+		pos.enpassant = move->ep;
+		pos.hash ^= zobrist.ep[pos.enpassant];
+	}
+
+	position_refresh();
+}
+
+/*
+Generate the legal moves. When captures_only is set (quiescence search),
+only captures and promotions are generated, except in check where all the
+evasions are returned.
+*/
+static int genMoves(Move *movelist, int captures_only)
 {
 	movelistcount = 0;
 
@@ -932,6 +1066,7 @@ int position_generateMoves(Move *movelist)
 	Square from, to;
 	U64 moves = EMPTY;
 	U64 pieces = OUR_PIECES & ~OUR_PAWNS;
+	U64 targets = captures_only ? OTHER_PIECES : (OTHER_PIECES | pos.bb_empty);
 	U64 singlePushs = EMPTY;
 	U64 doublePushs = EMPTY;
 
@@ -985,7 +1120,7 @@ int position_generateMoves(Move *movelist)
 	while (pieces) {
 		bb_from = LS1B(pieces);
 		from = bitboard_poplsb(&pieces);
-		moves = position_attacksFrom(from) & (OTHER_PIECES | pos.bb_empty);
+		moves = position_attacksFrom(from) & targets;
 		while (moves) {
 			bb_to = LS1B(moves);
 			to = bitboard_poplsb(&moves);
@@ -1005,7 +1140,10 @@ int position_generateMoves(Move *movelist)
 
 	/* Generate castling moves */
 
-	if (pos.side == WHITE && (pos.castling_rights & (W_CASTLE_K|W_CASTLE_Q))) {
+	if (captures_only) {
+		/* Castling is a quiet move */
+	}
+	else if (pos.side == WHITE && (pos.castling_rights & (W_CASTLE_K|W_CASTLE_Q))) {
 
 		from = lsb(OUR_KING);
 		if ((pos.castling_rights & W_CASTLE_K) && !W_ROCK_ATTACKED_KS && !W_ROCK_OCCUPIED_KS) {
@@ -1042,6 +1180,12 @@ int position_generateMoves(Move *movelist)
 		doublePushs = bitboard_soutOne(singlePushs) & pos.bb_empty & RANK5;
 	}
 
+	if (captures_only) {
+		/* Only the promotions are kept from the pawn pushes */
+		singlePushs &= RANK18;
+		doublePushs = EMPTY;
+	}
+
 	while (singlePushs) {
 		bb_to = LS1B(singlePushs);
 		bb_from = (pos.side == WHITE) ? bb_to >> 8 : bb_to << 8;
@@ -1072,3 +1216,55 @@ int position_generateMoves(Move *movelist)
 	return movelistcount;
 }
 
+int position_generateMoves(Move *movelist)
+{
+	return genMoves(movelist, 0);
+}
+
+int position_generateCaptures(Move *movelist)
+{
+	return genMoves(movelist, 1);
+}
+
+Piece position_pieceOn(Square sq)
+{
+	return pos.board[sq];
+}
+
+U64 position_attackersTo(Square sq, U64 occupied)
+{
+	U64 bb_sq = SQ64(sq);
+
+	return ((bitboard_soWeOne(bb_sq) | bitboard_soEaOne(bb_sq)) & pos.bb_pieces[P])
+	     | ((bitboard_noWeOne(bb_sq) | bitboard_noEaOne(bb_sq)) & pos.bb_pieces[p])
+	     | (bitboard_getKnightMoves(sq) & KNIGHTS)
+	     | (bitboard_getKingMoves(sq) & KINGS)
+	     | (Rmagic(sq, occupied) & QUEEN_ROOKS)
+	     | (Bmagic(sq, occupied) & QUEEN_BISHOPS);
+}
+
+int position_isDraw(int ply)
+{
+	int i, repetitions = 0;
+	int count = pos.history_count;
+	int end = (pos.halfmove < count) ? pos.halfmove : count;
+
+	if (pos.halfmove >= 100) return 1;
+
+	/* The same side is to move every other ply, the previous move can't repeat */
+	for (i = 4; i <= end; i += 2) {
+		if (count - i >= POSITION_HISTORY) continue;
+
+		if (pos.history[count - i] == pos.hash) {
+			if (i < ply) return 1;
+			if (++repetitions == 2) return 1;
+		}
+	}
+
+	return 0;
+}
+
+int position_kingAttacked()
+{
+	return (position_attackersTo(lsb(OUR_KING), pos.bb_occupied) & OTHER_PIECES) != 0;
+}
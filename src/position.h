@@ -34,9 +34,13 @@ Castle rights
 #define B_CASTLE_K 0x4 /* 0100 : 4 */
 #define B_CASTLE_Q 0x8 /* 1000 : 8 */
 
+/* Hash keys kept for the repetition detection, game and search plies */
+#define POSITION_HISTORY 1024
+
 
 typedef struct {
 	U64 bb_pieces[12]; // Pieces occupancy
+	U8 board[64]; // Piece on each square, NONE_PIECE if empty
 	U64 bb_side[2]; // Side occupancy
 	U64 bb_occupied;
 	U64 bb_empty ;
@@ -62,9 +66,25 @@ typedef struct {
 
 	int side; // White : 0, black : 1
 	U64 hash;
+
+	/* Sums of eval_psqMg and eval_psqEg over the pieces, and sum of their eval_phase */
+	int psq_mg;
+	int psq_eg;
+	int phase;
+
+	int halfmove; // Plies since the last capture or pawn move, for the fifty-move rule
+	int fullmove; // Starts at 1 and is incremented after black moves
+
+	/* Hash of the positions before each move made, last one on top */
+	U64 history[POSITION_HISTORY];
+	int history_count;
 } Position;
 
-extern Position pos;
+/*
+Each search thread works on its own copy of the position. The UCI thread
+owns the root position that is handed to the searchers on "go".
+*/
+extern _Thread_local Position pos;
 
 typedef struct {
 	U64 nodes;
@@ -85,6 +105,20 @@ void position_init();
  */
 int position_fromFen(const char *fen);
 
+/**
+ * Fen writer
+ * @param fen room for at least 100 characters
+ */
+void position_toFen(char *fen);
+
+/**
+ * Set up a position without parsing a FEN: position_init(), a call to
+ * position_addPiece() for each piece, then position_setState() which
+ * completes the position
+ */
+void position_addPiece(Piece piece, Square sq);
+void position_setState(int side, int castling_rights, Square enpassant, int halfmove, int fullmove);
+
 /**
  * Display the board
  */
@@ -96,6 +130,25 @@ void position_display();
  */
 int position_generateMoves(Move *movelist);
 
+/**
+ * Generate legal captures and promotions, or all the evasions when in check
+ * @param movelist pointer to a moves array
+ */
+int position_generateCaptures(Move *movelist);
+
+/**
+ * Piece standing on a square
+ * @return the piece or NONE_PIECE if the square is empty
+ */
+Piece position_pieceOn(Square sq);
+
+/**
+ * All the pieces of both sides attacking a square, sliders being blocked by
+ * the given occupancy. Contrary to the attack maps of the move generator,
+ * this doesn't need the moves to be generated first.
+ */
+U64 position_attackersTo(Square sq, U64 occupied);
+
 /**
  * Make a move
  */
@@ -106,6 +159,32 @@ void position_makeMove(Move *move);
  */
 void position_undoMove(Move *move);
 
+/**
+ * Make a null move: the side to move passes its turn. The move
+ * receives the state needed by position_undoNullMove()
+ */
+void position_makeNullMove(Move *move);
+
+/**
+ * Undo a null move
+ */
+void position_undoNullMove(Move *move);
+
+/**
+ * Draw by the fifty-move rule or by repetition. A position repeated inside
+ * the search (fewer than ply moves ago) is a draw, a position of the game
+ * must have occurred twice before.
+ * Only the positions since the last irreversible move are scanned.
+ * @param ply number of moves made since the root of the search
+ */
+int position_isDraw(int ply);
+
+/**
+ * Is the king of the side to move attacked? Contrary to position_inCheck(),
+ * this doesn't need the moves to be generated first.
+ */
+int position_kingAttacked();
+
 int position_inCheck();
 
 #endif
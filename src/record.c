@@ -0,0 +1,173 @@
+/**
+* Byak, a UCI chess engine.
+* Copyright (C) 2013  Sylvain Philip
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#if defined(__linux__)
+/* mmap() and madvise() are not part of C11 */
+#define _GNU_SOURCE
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "types.h"
+#include "bitboard.h"
+#include "position.h"
+#include "record.h"
+
+/* Records read at once when the file isn't mapped */
+#define BLOCK_RECORDS 4096
+
+int record_fromPosition(Record * record, int score, int result)
+{
+	U64 occupied = pos.bb_occupied;
+	int n = 0;
+
+	if (bitboard_popCount(occupied) > 32) return 0;
+
+	memset(record, 0, sizeof(Record));
+	record->occupied = occupied;
+
+	while (occupied) {
+		Square sq = bitboard_poplsb(&occupied);
+		record->pieces[n / 2] |= pos.board[sq] << ((n & 1) * 4);
+		n++;
+	}
+
+	record->flags = pos.side | (pos.castling_rights << 1);
+	record->ep = pos.enpassant;
+	record->halfmove = MIN(pos.halfmove, 255);
+	record->result = result;
+	record->fullmove = pos.fullmove;
+	record->score = score;
+
+	return 1;
+}
+
+int record_toPosition(const Record * record)
+{
+	U64 occupied = record->occupied;
+	int n = 0;
+
+	if (bitboard_popCount(occupied) > 32 || (record->ep >= TOTAL_SQUARES && record->ep != NONE_SQUARE)) return 0;
+
+	position_init();
+
+	while (occupied) {
+		Square sq = bitboard_poplsb(&occupied);
+		Piece piece = (record->pieces[n / 2] >> ((n & 1) * 4)) & 0xF;
+
+		if (piece >= NONE_PIECE) return 0;
+
+		position_addPiece(piece, sq);
+		n++;
+	}
+
+	position_setState(record->flags & 1, (record->flags >> 1) & 0xF, record->ep, record->halfmove,
+	                  record->fullmove);
+
+	return 1;
+}
+
+int record_fromFen(Record * record, const char * fen, int score, int result)
+{
+	position_init();
+
+	if (position_fromFen(fen) < 0) return 0;
+
+	return record_fromPosition(record, score, result);
+}
+
+int record_toFen(const Record * record, char * fen)
+{
+	if (!record_toPosition(record)) return 0;
+
+	position_toFen(fen);
+
+	return 1;
+}
+
+int record_open(RecordReader * reader, const char * path)
+{
+	memset(reader, 0, sizeof(RecordReader));
+
+#if defined(__linux__)
+	int fd = open(path, O_RDONLY);
+	struct stat st;
+
+	if (fd < 0) return 0;
+
+	if (fstat(fd, &st) == 0 && st.st_size >= (off_t) sizeof(Record)) {
+		void * map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+		if (map != MAP_FAILED) {
+			/* Read ahead aggressively, the pages already read are dropped first */
+			madvise(map, st.st_size, MADV_SEQUENTIAL);
+			close(fd);
+
+			reader->records = map;
+			reader->size = st.st_size;
+			reader->count = st.st_size / sizeof(Record);
+			return 1;
+		}
+	}
+
+	close(fd);
+#endif
+
+	reader->file = fopen(path, "rb");
+	reader->buffer = malloc(BLOCK_RECORDS * sizeof(Record));
+
+	if (!reader->file || !reader->buffer) {
+		record_close(reader);
+		return 0;
+	}
+
+	reader->records = reader->buffer;
+
+	return 1;
+}
+
+const Record * record_next(RecordReader * reader)
+{
+	if (reader->next == reader->count) {
+		if (!reader->file) return NULL;
+
+		reader->count = fread(reader->buffer, sizeof(Record), BLOCK_RECORDS, reader->file);
+		reader->next = 0;
+
+		if (!reader->count) return NULL;
+	}
+
+	return &reader->records[reader->next++];
+}
+
+void record_close(RecordReader * reader)
+{
+#if defined(__linux__)
+	if (reader->size) munmap((void *) reader->records, reader->size);
+#endif
+
+	if (reader->file) fclose(reader->file);
+	free(reader->buffer);
+
+	memset(reader, 0, sizeof(RecordReader));
+}
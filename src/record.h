@@ -0,0 +1,85 @@
+/**
+* Byak, a UCI chess engine.
+* Copyright (C) 2013  Sylvain Philip
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef RECORD_H
+#define RECORD_H
+
+#include <stdio.h>
+#include "types.h"
+
+/* Result of the game a record comes from */
+#define RECORD_BLACK_WINS 0
+#define RECORD_DRAW       1
+#define RECORD_WHITE_WINS 2
+#define RECORD_UNKNOWN    3
+
+/*
+Position of a dataset, 32 bytes, written as is in the byte order of the
+host. The pieces of the occupied squares, from a1 to h8, are packed two per
+byte: the piece of the n-th occupied square is in the low nibble of byte
+n / 2 when n is even, in the high nibble when n is odd.
+*/
+typedef struct {
+	U64 occupied;
+	U8 pieces[16];
+	U8 flags;       // Side to move (bit 0) and castling rights (bits 1 to 4)
+	U8 ep;          // En passant square, NONE_SQUARE if none
+	U8 halfmove;    // Capped to 255
+	U8 result;      // RECORD_BLACK_WINS, RECORD_DRAW, RECORD_WHITE_WINS or RECORD_UNKNOWN
+	U16 fullmove;
+	S16 score;      // Search score from white's point of view, in centipawns
+} Record;
+
+_Static_assert(sizeof(Record) == 32, "Record must be packed in 32 bytes");
+
+/**
+ * Pack the current position
+ * @return 0 if the position has more than 32 pieces
+ */
+int record_fromPosition(Record * record, int score, int result);
+
+/**
+ * Unpack a record into the current position, without the history of the game
+ * @return 0 if the record is corrupted
+ */
+int record_toPosition(const Record * record);
+
+/* Conversions through the current position of the calling thread, see position_toFen() for the size of fen */
+int record_fromFen(Record * record, const char * fen, int score, int result);
+int record_toFen(const Record * record, char * fen);
+
+/*
+Sequential reader of a file of records. The file is mapped in memory when
+the system allows it, otherwise it is read by blocks.
+*/
+typedef struct {
+	const Record * records;   // The mapped file, or the block read
+	size_t count;             // Records in records
+	size_t next;              // Next record to return
+	size_t size;              // Size of the mapping, 0 when reading by blocks
+	FILE * file;
+	Record * buffer;
+} RecordReader;
+
+/* @return 0 if the file can't be read */
+int record_open(RecordReader * reader, const char * path);
+/* @return the next record, NULL at the end of the file */
+const Record * record_next(RecordReader * reader);
+void record_close(RecordReader * reader);
+
+#endif
@@ -17,7 +17,9 @@
 */
 
 #include <assert.h>
+#include <math.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include "types.h"
 #include "tt.h"
@@ -25,166 +27,1078 @@
 #include "position.h"
 #include "search.h"
 #include "eval.h"
-#include "time.h"
+#include "timer.h"
 #include "uci.h"
+#include "thread.h"
+
+/* Safety margin of the quiescence delta pruning */
+#define DELTA_MARGIN 200
+
+/* Time management: communication delay and moves to go when not given */
+#define MOVE_OVERHEAD      20
+#define MOVES_TO_GO        30
+/* The hard limit is at most this many soft limits */
+#define HARD_LIMIT_RATIO   4
+
+/* Bounds of the number of nodes between two readings of the clock */
+#define CHECK_INTERVAL_MIN 256
+#define CHECK_INTERVAL_MAX 65536
+
+/* currmove lines (ms): none during the first second, then at most one every 100 ms */
+#define INFO_DELAY    1000
+#define INFO_INTERVAL 100
+
+/* Half width of the first aspiration window and the depth it is used from */
+#define ASPIRATION_WINDOW 25
+#define ASPIRATION_DEPTH  4
+
+/* Null move pruning: minimal depth, and depth from which a cutoff is verified */
+#define NULL_MIN_DEPTH    3
+#define NULL_VERIFY_DEPTH 10
+
+/* Depths up to which the frontier pruning techniques apply */
+#define RAZOR_DEPTH            2
+#define REVERSE_FUTILITY_DEPTH 6
+#define FUTILITY_DEPTH         6
+#define LATE_MOVE_DEPTH        4
+
+SearchOption search_options[OPTIONS_COUNT] = {
+	{"RazorMargin",           300, 0, 2000},
+	{"ReverseFutilityMargin",  80, 0, 1000},
+	{"FutilityMargin",        100, 0, 1000},
+	{"LateMoveCount",           3, 0,   64},
+	{"MultiPV",                 1, 1, MAX_MULTIPV}
+};
+
+#define OPTION(id) (search_options[id].value)
+
+/* Search of the pool, and search of the calling thread: the pool's one or a search_single() */
+static SearchInfos pool_infos;
+static _Thread_local SearchInfos * info = &pool_infos;
+
+/* Lazy SMP: all the threads search the same root position and share the TT */
+static SearchThread threads[MAX_THREADS];
+static int threads_count = 1;
+
+/* State of the calling search thread */
+static _Thread_local SearchThread * thread;
+
+/* Late move reductions by depth and move number, see initReductions() */
+static int reductions[MAX_DEPTH + 1][64];
+
+/* Pool of search threads, parked on pool_wakeup between two searches */
+static Thread pool[MAX_THREADS];
+static Mutex pool_lock;
+static Cond pool_wakeup;
+static Cond pool_idle;
+static Cond pool_stop;
+static int pool_generation = 0;
+static int pool_running = 0;
+static int pool_exit = 0;
+
+/*
+The PV of a node is its best move followed by the PV of the child.
+Each node clears its PV when entered, so only the moves actually
+searched below are copied.
+*/
+static void _updatePV(Move * mv, int ply)
+{
+	SearchStack * ss = &thread->stack[ply];
+	SearchStack * child = &thread->stack[ply + 1];
+
+	ss->pv[0] = *mv;
+	memcpy(ss->pv + 1, child->pv, child->pv_length * sizeof(Move));
+	ss->pv_length = child->pv_length + 1;
+}
+
+/*
+The PV of the previous iteration is in stack[0].pv: the child reached by
+mv is still on it when this node is and mv is the PV move of this ply.
+*/
+static inline void followPV(Move * mv, int ply)
+{
+	thread->stack[ply + 1].follow_pv = thread->stack[ply].follow_pv
+		&& ply < thread->stack[0].pv_length && SAME_MOVE(*mv, thread->stack[0].pv[ply]);
+}
 
-static int movestogo = 40;
 
-static SearchInfos infos;
+/* Move ordering scores, the highest first */
+#define SCORE_PV          60000
+#define SCORE_HASH        55000
+#define SCORE_PROMOTION   50000
+#define SCORE_CAPTURE     40000
 
-static void _updatePV(Move * mv, int ply)
+#define SCORE_KILLER1     30000
+#define SCORE_KILLER2     29000
+#define SCORE_COUNTER     28000
+
+/* History scores stay within [-HISTORY_MAX, HISTORY_MAX] */
+#define HISTORY_MAX       8192
+
+#define IS_QUIET(move) (!((move).flags & (MOVE_CAPTURE | MOVE_PROMOTION)))
+
+/*
+Most Valuable Victim - Least Valuable Aggressor: the captures of the
+biggest pieces come first, by the smallest attacker first
+*/
+static inline unsigned int mvvLva(Move * move)
 {
-	/*
-	int pvIndex = 0.5 * ply * ((2*MAX_DEPTH) + 1 - ply);
-	int pvNextIndex = pvIndex + MAX_DEPTH - ply;
-	assert(pvIndex >= 0 && pvIndex <= 528);
-	assert(pvNextIndex >= 0 && pvNextIndex <= 528);
-
-	pv_array[pvIndex] = *mv;
-	int infos.pv_length;
-	Move * pTarget = pv_array + pvIndex + 1;
-	Move * pSource = pv_array + pvNextIndex;
-	for (infos.pv_length = MAX_DEPTH - ply - 1; infos.pv_length >=0; infos.pv_length--) {
-		*pTarget++ = *pSource++;
-	}
-	*/
+	Piece victim = (move->flags & MOVE_ENPASSANT) ? P : pos.board[move->to];
+	Piece attacker = pos.board[move->from];
+
+	return eval_pieceValue[victim] * 8 - eval_pieceValue[attacker] / 100;
+}
+
+/*
+Move which refuted the previous move the last time it was played,
+an empty move at the root
+*/
+static inline Move counterMove(int ply)
+{
+	static const Move none = {0};
+
+	if (!ply) return none;
 
-	int j;
+	Move * previous = &thread->stack[ply - 1].move;
 
-	if (!infos.pv_length[ply]) {
-		infos.pv_length[ply] = ply;
+	if (previous->flags == MOVE_NULL) return none;
+
+	return thread->counters[pos.board[previous->to]][previous->to];
+}
+
+/*
+History gravity: the bonus shrinks as the score approaches the bounds,
+so that the table keeps adapting to the recent cutoffs
+*/
+static inline void updateHistory(int * entry, int bonus)
+{
+	*entry += bonus - *entry * (bonus < 0 ? -bonus : bonus) / HISTORY_MAX;
+}
+
+/*
+A quiet move caused a beta cutoff. It becomes a killer for this ply and
+the counter move of the previous move. Its history is raised and the
+history of the quiet moves searched before it is lowered.
+*/
+static void updateQuietStats(Move * move, Move ** quiets, int quietsCount, int depth, int ply)
+{
+	int i;
+	int bonus = depth * depth;
+	Move * killers = thread->stack[ply].killers;
+
+	if (bonus > 400) bonus = 400;
+
+	if (!SAME_MOVE(*move, killers[0])) {
+		killers[1] = killers[0];
+		killers[0] = *move;
 	}
 
-	infos.pv[ply][ply] = *mv;
-	for (j = ply + 1; j < infos.pv_length[ply + 1]; ++j)
-		infos.pv[ply][j] = infos.pv[ply + 1][j];
+	if (ply && thread->stack[ply - 1].move.flags != MOVE_NULL) {
+		Move * previous = &thread->stack[ply - 1].move;
+		thread->counters[pos.board[previous->to]][previous->to] = *move;
+	}
 
-	if (infos.pv_length[ply + 1])
-		infos.pv_length[ply] = infos.pv_length[ply + 1];
-	else if (!ply)
-		infos.pv_length[0] = 1;
+	updateHistory(&thread->history[pos.side][move->from][move->to], bonus);
 
+	for (i=0; i < quietsCount; i++) {
+		updateHistory(&thread->history[pos.side][quiets[i]->from][quiets[i]->to], -bonus);
+	}
 }
 
-static void sortMoves(Move * movelist, int listlen, int ply)
+/*
+Fill the score of each move. The moves are not sorted, pickMove() selects
+the next best one lazily, as a cutoff often happens after a few moves.
+*/
+static void scoreMoves(Move * movelist, int listlen, int ply, U16 hashMove)
 {
 	int i;
-	Move temp;
+	Move * move;
+	Move * killers = thread->stack[ply].killers;
+	Move counter = counterMove(ply);
+
 	for (i=0; i < listlen; i++)  {
-		// If the move in the list matches the first move in the PV...
-		if (movelist[i].from == infos.pv[0][ply].from &&
-			movelist[i].to == infos.pv[0][ply].to) {
-			// ... we move it on the top of the stack.
-			temp = movelist[0];
-			movelist[0] = movelist[i];
-			movelist[i] = temp;
+		move = &movelist[i];
+		move->score = 0;
+
+		// The move of the principal variation is searched first, on the PV only
+		if (thread->stack[ply].follow_pv && ply < thread->stack[0].pv_length
+			&& SAME_MOVE(*move, thread->stack[0].pv[ply])) {
+			move->score = SCORE_PV;
+			continue;
+		}
+
+		// Then the best move stored in the transposition table
+		if (hashMove && move_pack(move) == hashMove) {
+			move->score = SCORE_HASH;
+			continue;
+		}
+
+		if (move->flags & MOVE_PROMOTION) {
+			move->score = SCORE_PROMOTION;
+			if (move->flags & MOVE_PROMOTION_QUEEN) move->score += eval_pieceValue[Q];
+		}
+
+		if (move->flags & MOVE_CAPTURE) {
+			move->score += SCORE_CAPTURE + mvvLva(move);
+			continue;
+		}
+
+		if (move->flags & MOVE_PROMOTION) continue;
+
+		if (SAME_MOVE(*move, killers[0])) {
+			move->score = SCORE_KILLER1;
+		}
+		else if (SAME_MOVE(*move, killers[1])) {
+			move->score = SCORE_KILLER2;
+		}
+		else if (SAME_MOVE(*move, counter)) {
+			move->score = SCORE_COUNTER;
+		}
+		else {
+			move->score = HISTORY_MAX + thread->history[pos.side][move->from][move->to];
+		}
+	}
+}
+
+
+/*
+Partial selection sort: bring the best scored move of the remaining ones
+at the index position
+*/
+static inline Move * pickMove(Move * movelist, int listlen, int index)
+{
+	int i, best = index;
+	Move temp;
+
+	for (i=index + 1; i < listlen; i++) {
+		if (movelist[i].score > movelist[best].score) best = i;
+	}
+
+	if (best != index) {
+		temp = movelist[index];
+		movelist[index] = movelist[best];
+		movelist[best] = temp;
+	}
+
+	return &movelist[index];
+}
+
+/*
+Helper threads search the root moves in a different order so that they
+don't all walk the same tree. The PV move stays first.
+*/
+static void rotateMoves(Move * movelist, int listlen, int shift)
+{
+	Move temp;
+	int i, j;
+
+	if (listlen < 3) return;
+
+	shift %= listlen - 1;
+
+	for (i=0; i < shift; i++) {
+		temp = movelist[1];
+		for (j=1; j < listlen - 1; j++) {
+			movelist[j] = movelist[j + 1];
+		}
+		movelist[listlen - 1] = temp;
+	}
+}
+
+/*
+Reading the clock at every node would cost a visible share of the search.
+The main thread reads it every few nodes only, the interval being adapted
+to the speed of the search for about one reading per millisecond.
+*/
+static inline void timeControl()
+{
+	if (thread->nodes < info->next_check) return;
+
+	info->time_used = GET_TIME() - info->time_start;
+
+	U64 interval = info->time_used ? thread->nodes / info->time_used : CHECK_INTERVAL_MIN;
+
+	if (interval < CHECK_INTERVAL_MIN) interval = CHECK_INTERVAL_MIN;
+	if (interval > CHECK_INTERVAL_MAX) interval = CHECK_INTERVAL_MAX;
+
+	/* The node limit is checked exactly when the main thread searches alone */
+	if (info->nodes) {
+		U64 nodes = info->single ? thread->nodes : search_nodes();
+		int count = info->single ? 1 : threads_count;
+
+		if (nodes >= info->nodes) {
+			info->stop = 1;
+			return;
+		}
+
+		if (interval > (info->nodes - nodes) / count) {
+			interval = (info->nodes - nodes) / count;
+		}
+	}
+
+	info->next_check = thread->nodes + interval;
+
+	/* The clock of the opponent is running */
+	if (info->ponder) return;
+
+	if (info->hard_limit && info->time_used >= info->hard_limit) {
+		info->stop = 1;
+	}
+}
+
+static void initThread(SearchThread * th)
+{
+	th->null_verify = 0;
+	th->nodes = 0;
+	th->depth = 0;
+	th->score = -INFINITY;
+	th->pv_length = 0;
+}
+
+/*
+Called by the thread itself at the start of a search
+*/
+static void initStack()
+{
+	int ply;
+
+	for (ply=0; ply <= MAX_PLY; ply++) {
+		memset(thread->stack[ply].killers, 0, sizeof(thread->stack[ply].killers));
+		thread->stack[ply].pv_length = 0;
+	}
+
+	thread->stack[0].moves = thread->arena;
+}
+
+/*
+Pick the thread with the deepest completed iteration, the best score
+breaking the ties. The main thread wins if no helper went deeper.
+*/
+static SearchThread * bestThread()
+{
+	SearchThread * best = &threads[0];
+	int i;
+
+	for (i=1; i < threads_count; i++) {
+		SearchThread * th = &threads[i];
+		if (!th->pv_length) continue;
+		if (th->depth > best->depth || (th->depth == best->depth && th->score > best->score)) {
+			best = th;
+		}
+	}
+
+	return best;
+}
+
+/*
+The expected reply to the best move: the second move of the PV, or the move
+stored in the transposition table when the PV was cut
+*/
+static int ponderMove(SearchThread * best, Move * ponder)
+{
+	Move movelist[MAX_MOVES];
+	Move bestMove = best->pv[0];
+	U16 hashMove;
+	int i, listLen, found = 0;
+
+	if (!best->pv_length) return 0;
+
+	if (best->pv_length > 1) {
+		*ponder = best->pv[1];
+		return 1;
+	}
+
+	position_makeMove(&bestMove);
+	tt_probe(pos.hash, -INFINITY, INFINITY, 0, 1, &hashMove);
+
+	listLen = hashMove ? position_generateMoves(movelist) : 0;
+
+	for (i=0; i < listLen; i++) {
+		if (move_pack(&movelist[i]) == hashMove) {
+			*ponder = movelist[i];
+			found = 1;
 			break;
 		}
 	}
+
+	position_undoMove(&bestMove);
+
+	return found;
 }
 
-static void timeControl()
+/* The PV of the last completed iteration is the current PV of the thread */
+static int sameLine(SearchThread * th)
 {
-	/*
-	time_used = GET_TIME() - time_start
-	timeleft = movetime - time_used;
+	int i;
+
+	if (th->pv_length != th->stack[0].pv_length) return 0;
+
+	for (i=0; i < th->pv_length; i++) {
+		if (!SAME_MOVE(th->pv[i], th->stack[0].pv[i])) return 0;
+	}
 
-	if (time_used > timeleft) we stop the search now
+	return 1;
+}
+
+static void search_main()
+{
+	search_iterate();
 
-	Simplifying the equations:
-	time_used > timeleft = timeused > (movetime - time_used) = (time_used * 2) > movetime
+	mutex_lock(&pool_lock);
 
+	/*
+	An infinite search only ends with stop, even if the depth limit is reached.
+	A ponder search waits for stop or ponderhit.
 	*/
-	if (!infos.movetime) return;
+	while ((info->infinite || info->ponder) && !info->stop) {
+		cond_wait(&pool_stop, &pool_lock);
+	}
 
-	infos.time_used = GET_TIME() - infos.time_start;
+	/* The main thread is done, stop the helpers and wait for them */
+	info->stop = 1;
 
-	if ((infos.time_used) * 2 > infos.movetime) {
-		infos.stop = 1;
+	while (pool_running > 1) {
+		cond_wait(&pool_idle, &pool_lock);
 	}
+	mutex_unlock(&pool_lock);
+
+	SearchThread * best = bestThread();
+
+	/* Stopped before the first iteration completed: the partial line is all there is */
+	if (!best->pv_length && best->stack[0].pv_length) {
+		best->pv_length = best->stack[0].pv_length;
+		memcpy(best->pv, best->stack[0].pv, best->pv_length * sizeof(Move));
+	}
+
+	/* The line printed last may be the one of an interrupted iteration */
+	if (best != thread || !sameLine(best)) {
+		uci_print_pv(best->score, best->depth, info->time_start, best->pv, best->pv_length);
+	}
+
+	Move bestMove = best->pv[0];
+	Move ponder;
+
+	/* Checkmate or stalemate: no best move */
+	if (!best->pv_length) {
+		uci_print_bestmove(NULL, NULL);
+		return;
+	}
+
+	uci_print_bestmove(&bestMove, ponderMove(best, &ponder) ? &ponder : NULL);
 }
 
+/*
+Body of the pooled threads. They are created once and sleep on the
+wakeup condition until search_go() publishes a new search.
+*/
+static int allocThread(SearchThread * th)
+{
+	th->stack = calloc(MAX_PLY + 1, sizeof(SearchStack));
+	th->arena = calloc(MAX_PLY * MAX_MOVES, sizeof(Move));
+	th->lines = calloc(MAX_MULTIPV, sizeof(RootLine));
 
-void* search_start(void* data)
+	return th->stack && th->arena && th->lines;
+}
+
+static void freeThread(SearchThread * th)
 {
-	SearchInfos * pInfos = data;
+	free(th->stack);
+	free(th->arena);
+	free(th->lines);
+}
 
-	infos = *pInfos;
+static void* search_loop(void* data)
+{
+	int generation = 0;
 
-	infos.time_start = GET_TIME();
-	infos.my_side = pos.side;
-	infos.stop = 0;
+	thread = data;
 
-	if (infos.time[pos.side]) {
-		// Avoids division by zero 
-		if (movestogo < 1) movestogo += 10;
+	/* Allocated here, the memory is close to the core running the thread */
+	if (!allocThread(thread)) {
+		printf("Search thread %d: out of memory\n", thread->id);
+		exit(1);
+	}
+
+	while (1) {
+		mutex_lock(&pool_lock);
+		while (generation == pool_generation && !pool_exit) {
+			cond_wait(&pool_wakeup, &pool_lock);
+		}
+		generation = pool_generation;
+		mutex_unlock(&pool_lock);
+
+		if (pool_exit) break;
 
-		if (infos.time[pos.side] >= infos.time[1 ^ pos.side]) {
-			// We have more time than the other side, so we simply 
-			// divide our time to the estimated moves to go
-			infos.movetime = infos.time[pos.side] / movestogo;
+		pos = info->root;
+		initStack();
+
+		if (thread->id == 0) {
+			search_main();
 		} else {
-			// Try to accelerate the time to find the best move
-			infos.movetime = (infos.time[pos.side] - (infos.time[1 ^ pos.side]-infos.time[pos.side])) / movestogo;
+			search_iterate();
 		}
-		movestogo--;
+
+		mutex_lock(&pool_lock);
+		pool_running--;
+		cond_broadcast(&pool_idle);
+		mutex_unlock(&pool_lock);
 	}
 
-	if (!infos.depth) infos.depth = MAX_DEPTH;
+	freeThread(thread);
 
-	memset(infos.pv, 0, sizeof(infos.pv));
-	memset(infos.pv_length, 0, sizeof(infos.pv_length));
+	return NULL;
+}
 
-	search_iterate();
+/*
+The new threads start at generation 0: the counter is reset with them, else
+they would run the last search again as soon as they are created
+*/
+static void pool_create()
+{
+	int i;
 
-	Move bestMove = infos.pv[0][0];
+	pool_exit = 0;
+	pool_generation = 0;
 
-	uci_print_bestmove(&bestMove);
+	for (i=0; i < threads_count; i++) {
+		threads[i].id = i;
+		initThread(&threads[i]);
+		thread_create(&pool[i], search_loop, &threads[i]);
+	}
+}
 
-	return NULL;
+static void pool_destroy()
+{
+	int i;
+
+	mutex_lock(&pool_lock);
+	pool_exit = 1;
+	cond_broadcast(&pool_wakeup);
+	mutex_unlock(&pool_lock);
+
+	for (i=0; i < threads_count; i++) {
+		thread_join(pool[i]);
+	}
+}
+
+/*
+The later a move comes in the ordering, the less likely it is to be the best
+one. The reduction grows with the logarithm of both the depth and the move
+number.
+*/
+static void initReductions()
+{
+	int depth, index;
+
+	for (depth = 1; depth <= MAX_DEPTH; depth++) {
+		for (index = 1; index < 64; index++) {
+			reductions[depth][index] = (int) (0.75 + log(depth) * log(index) / 2.25);
+		}
+	}
+}
+
+void search_init()
+{
+	initReductions();
+	mutex_init(&pool_lock);
+	cond_init(&pool_wakeup);
+	cond_init(&pool_idle);
+	cond_init(&pool_stop);
+	pool_create();
+}
+
+/*
+Time for this move. The soft limit is an equal share of the remaining time
+plus most of the increment, the hard limit leaves room for the search to
+finish an unstable iteration without endangering the clock.
+*/
+static void allocateTime(SearchInfos * search)
+{
+	int time = search->time[search->my_side];
+	int inc = search->inc[search->my_side];
+	int movestogo = search->movestogo ? search->movestogo : MOVES_TO_GO;
+	int available;
+
+	search->soft_limit = 0;
+	search->hard_limit = 0;
+
+	if (search->movetime) {
+		search->soft_limit = search->hard_limit = MAX(search->movetime - MOVE_OVERHEAD, 1);
+		return;
+	}
+
+	if (!time && !inc) return;
+
+	if (movestogo > MOVES_TO_GO) movestogo = MOVES_TO_GO;
+
+	available = MAX(time - MOVE_OVERHEAD, 1);
+
+	search->soft_limit = available / movestogo + inc * 3 / 4;
+
+	/* With more moves to go, keep a reserve for them */
+	search->hard_limit = (movestogo == 1) ? available : available * 3 / 4;
+	search->hard_limit = MIN(search->hard_limit, search->soft_limit * HARD_LIMIT_RATIO);
+	search->soft_limit = MIN(search->soft_limit, search->hard_limit);
+}
+
+/*
+The soft limit is stretched when the best move changed in the last
+iterations or when the score dropped, and shrunk when the search is stable.
+changes is the decaying count of best move changes, drop the score loss
+since the previous iteration. A fixed movetime is not scaled.
+*/
+static int softLimitReached(float changes, int drop)
+{
+	if (info->movetime) return GET_TIME() - info->time_start >= info->soft_limit;
+
+	float scale = 0.7 + 0.6 * changes;
+
+	if (drop > 0) scale *= 1.0 + MIN(drop, 100) / 100.0;
+
+	if (scale > 3) scale = 3;
+
+	return GET_TIME() - info->time_start >= info->soft_limit * scale;
+}
+
+/* Start the clock and set the limits of a search */
+static void startSearch(SearchInfos * search)
+{
+	search->time_start = GET_TIME();
+	search->next_check = 0;
+	search->next_info = search->time_start + INFO_DELAY;
+	search->my_side = search->root.side;
+	search->stop_on_ponderhit = 0;
+
+	allocateTime(search);
+
+	if (!search->depth || search->depth > MAX_DEPTH) search->depth = MAX_DEPTH;
+}
+
+void search_go(SearchInfos * limits)
+{
+	int i;
+
+	/*
+	The previous search may still be between bestmove and going idle.
+	A go received in the middle of a search ends that search first.
+	*/
+	search_stop();
+	search_wait();
+
+	mutex_lock(&pool_lock);
+
+	pool_infos = *limits;
+	pool_infos.single = 0;
+	pool_infos.stop = 0;
+	startSearch(&pool_infos);
+
+	for (i=0; i < threads_count; i++) {
+		initThread(&threads[i]);
+	}
+
+	pool_running = threads_count;
+	pool_generation++;
+	cond_broadcast(&pool_wakeup);
+
+	mutex_unlock(&pool_lock);
+}
+
+SearchThread * search_newThread()
+{
+	SearchThread * th = calloc(1, sizeof(SearchThread));
+
+	if (th && !allocThread(th)) {
+		search_freeThread(th);
+		th = NULL;
+	}
+
+	return th;
+}
+
+void search_freeThread(SearchThread * th)
+{
+	if (!th) return;
+
+	freeThread(th);
+	free(th);
+}
+
+void search_single(SearchThread * th, SearchInfos * limits)
+{
+	thread = th;
+	info = limits;
+
+	info->single = 1;
+	info->ponder = 0;
+	info->infinite = 0;
+	startSearch(info);
+
+	pos = info->root;
+	initThread(thread);
+	initStack();
+
+	search_iterate();
+
+	thread = NULL;
+	info = &pool_infos;
+}
+
+void search_wait()
+{
+	mutex_lock(&pool_lock);
+	while (pool_running) {
+		cond_wait(&pool_idle, &pool_lock);
+	}
+	mutex_unlock(&pool_lock);
 }
 
 void search_stop()
 {
-	infos.stop = 1;
+	mutex_lock(&pool_lock);
+	pool_infos.stop = 1;
+	cond_broadcast(&pool_stop);
+	mutex_unlock(&pool_lock);
+}
+
+void search_ponderhit()
+{
+	mutex_lock(&pool_lock);
+	pool_infos.ponder = 0;
+	if (pool_infos.stop_on_ponderhit) pool_infos.stop = 1;
+	cond_broadcast(&pool_stop);
+	mutex_unlock(&pool_lock);
+}
+
+void search_clear()
+{
+	int i;
+
+	search_wait();
+
+	for (i=0; i < MAX_THREADS; i++) {
+		memset(threads[i].history, 0, sizeof(threads[i].history));
+		memset(threads[i].counters, 0, sizeof(threads[i].counters));
+	}
+}
+
+void search_setThreads(int count)
+{
+	if (count < 1) count = 1;
+	if (count > MAX_THREADS) count = MAX_THREADS;
+
+	if (count == threads_count) return;
+
+	search_wait();
+	pool_destroy();
+	threads_count = count;
+	pool_create();
+}
+
+int search_setOption(const char * name, int value)
+{
+	int i;
+
+	for (i=0; i < OPTIONS_COUNT; i++) {
+		if (!strcmp(name, search_options[i].name)) {
+			if (value < search_options[i].min) value = search_options[i].min;
+			if (value > search_options[i].max) value = search_options[i].max;
+			search_options[i].value = value;
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+U64 search_nodes()
+{
+	U64 nodes = 0;
+	int i;
+
+	for (i=0; i < threads_count; i++) {
+		nodes += threads[i].nodes;
+	}
+
+	return nodes;
+}
+
+/*
+Pieces other than pawns and king, without them zugzwang is likely
+*/
+static inline int hasNonPawnMaterial(int side)
+{
+	return (pos.bb_pieces[N + side] | pos.bb_pieces[B + side]
+	      | pos.bb_pieces[R + side] | pos.bb_pieces[Q + side]) != 0;
+}
+
+/*
+Principal variation search. The first move is expected to be the best one
+and is searched with the full window. The others are only proved worse with
+a null window, and searched again with the full window when that fails.
+A late move may first be searched at a reduced depth, it is searched again
+at full depth only if it beats alpha.
+The caller has made the move, the score is from its point of view.
+*/
+static int searchChild(int alpha, int beta, int depth, int ply, int first, int reduction)
+{
+	int score;
+
+	if (first) {
+		return -search_alphaBeta(-beta, -alpha, depth - 1, ply);
+	}
+
+	if (reduction) {
+		score = -search_alphaBeta(-alpha - 1, -alpha, depth - 1 - reduction, ply);
+
+		if (score <= alpha) return score;
+	}
+
+	score = -search_alphaBeta(-alpha - 1, -alpha, depth - 1, ply);
+
+	if (score > alpha && score < beta) {
+		score = -search_alphaBeta(-beta, -alpha, depth - 1, ply);
+	}
+
+	return score;
+}
+
+/*
+MultiPV lines. The PV of the root is loaded from the line before it is
+searched, its moves are tried first at each ply.
+*/
+static void loadLine(RootLine * line)
+{
+	memcpy(thread->stack[0].pv, line->pv, line->pv_length * sizeof(Move));
+	thread->stack[0].pv_length = line->pv_length;
+}
+
+static void saveLine(RootLine * line, int score, int depth)
+{
+	line->score = score;
+	line->depth = depth;
+	line->pv_length = thread->stack[0].pv_length;
+	memcpy(line->pv, thread->stack[0].pv, line->pv_length * sizeof(Move));
+}
+
+/* Each search of the root finds the best remaining move, but the scores of the lines may be unordered */
+static void sortLines(int count)
+{
+	RootLine line;
+	int i, j;
+
+	for (i=1; i < count; i++) {
+		if (thread->lines[i].score <= thread->lines[i-1].score) continue;
+
+		line = thread->lines[i];
+		for (j = i; j > 0 && thread->lines[j-1].score < line.score; j--) {
+			thread->lines[j] = thread->lines[j-1];
+		}
+		thread->lines[j] = line;
+	}
+}
+
+/* Remove the first moves of the lines already searched by this iteration */
+static int excludeLines(Move * movelist, int listLen)
+{
+	int i, j;
+
+	for (i=0; i < thread->pv_index; i++) {
+		for (j=0; j < listLen; j++) {
+			if (SAME_MOVE(movelist[j], thread->lines[i].pv[0])) {
+				movelist[j] = movelist[--listLen];
+				break;
+			}
+		}
+	}
+
+	return listLen;
+}
+
+static void initLines()
+{
+	int i, count = position_generateMoves(thread->arena);
+	int wanted = info->single ? 1 : OPTION(OPTION_MULTIPV);
+
+	thread->multipv = (wanted < count) ? wanted : count;
+	thread->pv_index = 0;
+
+	if (thread->multipv < 1) thread->multipv = 1;
+
+	for (i=0; i < thread->multipv; i++) {
+		thread->lines[i].score = -INFINITY;
+		thread->lines[i].depth = 0;
+		thread->lines[i].pv_length = 0;
+	}
 }
 
 void search_iterate()
 {
-	int depth;
+	int depth, score = 0, previous = 0;
+	int alpha, beta, delta;
+	float changes = 0;
+	Move best = {0};
+
+	initLines();
+
+	/* Helpers with an odd id start one ply deeper to spread the threads over two depths */
+	for (depth = 1 + (thread->id & 1); depth <= info->depth; depth++) {
+
+		if (info->stop) break;
+
+		for (thread->pv_index = 0; thread->pv_index < thread->multipv; thread->pv_index++) {
+			if (thread->multipv > 1) {
+				/* Each line has its own window, around its score at the previous iteration */
+				score = thread->lines[thread->pv_index].score;
+				loadLine(&thread->lines[thread->pv_index]);
+			}
+
+			/*
+			Aspiration window: the score rarely moves much from one iteration to
+			the next, a narrow window around the previous score prunes more.
+			When the root fails low or high the window is widened on that side
+			and the iteration is searched again.
+			*/
+			delta = ASPIRATION_WINDOW;
+			alpha = -INFINITY;
+			beta = INFINITY;
+
+			if (depth >= ASPIRATION_DEPTH && !IS_MATE(score)) {
+				alpha = score - delta;
+				beta = score + delta;
+			}
+
+			while (1) {
+				score = search_root(alpha, beta, depth);
+
+				if (info->stop) break;
+
+				/* A full window is final, the root may have no moves at all */
+				if (score <= alpha && alpha > -INFINITY) {
+					alpha = (alpha - delta < -INFINITY) ? -INFINITY : alpha - delta;
+				}
+				else if (score >= beta && beta < INFINITY) {
+					beta = (beta + delta > INFINITY) ? INFINITY : beta + delta;
+				}
+				else {
+					break;
+				}
+
+				delta *= 2;
+			}
+
+			if (info->stop) break;
+
+			if (thread->multipv > 1) {
+				saveLine(&thread->lines[thread->pv_index], score, depth);
+			}
+		}
+
+		/* The best move is the one of the first line, even if the search was stopped in a later one */
+		if (thread->multipv > 1 && thread->pv_index > 0) {
+			sortLines(thread->pv_index);
+			loadLine(&thread->lines[0]);
+			score = thread->lines[0].score;
+		}
 
-	for (depth=1; depth <= infos.depth; depth++) {
+		if (info->stop) break;
 
-		if (infos.stop) break;
+		thread->depth = depth;
+		thread->score = score;
+		thread->pv_length = thread->stack[0].pv_length;
+		memcpy(thread->pv, thread->stack[0].pv, thread->pv_length * sizeof(Move));
+
+		if (thread->id == 0 && thread->multipv > 1 && !info->single) {
+			int i;
+			for (i=0; i < thread->multipv; i++) {
+				uci_print_multipv(i + 1, &thread->lines[i], info->time_start);
+			}
+		}
+
+		if (thread->id == 0 && info->soft_limit) {
+			if (depth > 1 && !SAME_MOVE(best, thread->stack[0].pv[0])) changes += 1;
+
+			if (softLimitReached(changes, depth > 1 ? previous - score : 0)) {
+				/* While pondering, the move is played as soon as the opponent plays the expected reply */
+				if (info->ponder) {
+					info->stop_on_ponderhit = 1;
+				} else {
+					info->stop = 1;
+					break;
+				}
+			}
+
+			changes /= 2;
+		}
 
-		search_root(-INFINITY, INFINITY, depth);
+		best = thread->stack[0].pv[0];
+		previous = score;
 	}
 }
 
 int search_root(int alpha, int beta, int depth)
 {
-	Move movelist[256];
+	Move * movelist = thread->stack[0].moves;
 	int score;
+	int is_main = (thread->id == 0);
+	int verbose = is_main && !info->single;
 
 	int listLen = position_generateMoves(movelist);
 
-	sortMoves(movelist, listLen, 0);
+	if (thread->pv_index) {
+		listLen = excludeLines(movelist, listLen);
+	}
+
+	thread->stack[1].moves = movelist + listLen;
+	thread->stack[0].static_eval = pos.in_check ? -INFINITY : eval_position();
+
 	int i;
 
+	/* The root list is small, sort it entirely */
+	U16 hashMove;
+	tt_probe(pos.hash, alpha, beta, depth, 0, &hashMove);
+	thread->stack[0].follow_pv = 1;
+	scoreMoves(movelist, listLen, 0, hashMove);
+	for (i=0; i < listLen; i++) {
+		pickMove(movelist, listLen, i);
+	}
+
+	if (!is_main) {
+		rotateMoves(movelist, listLen, thread->id + depth);
+	}
+
 	for (i=0; i < listLen; i++)  {
 		position_makeMove(&movelist[i]);
+		thread->stack[0].move = movelist[i];
+		followPV(&movelist[i], 0);
 
-		score = -search_alphaBeta(-beta, -alpha, depth, 1);
+		score = searchChild(alpha, beta, depth, 1, i == 0, 0);
 
-		uci_print_currmove(&movelist[i],depth, i+1);
-		uci_print_nps(infos.time_start, infos.nodes);
+		if (verbose && GET_TIME() >= info->next_info) {
+			uci_print_currmove(&movelist[i],depth, i+1);
+			uci_print_nps(info->time_start, search_nodes());
+			info->next_info = GET_TIME() + INFO_INTERVAL;
+		}
 
 		position_undoMove(&movelist[i]);
 
-		if (score > alpha && !infos.stop) {
+		if (info->stop) break;
+
+		if (score >= beta) {
+			// The aspiration window is too low, the caller widens it
+			_updatePV(&movelist[i], 0);
+			if (!thread->pv_index) {
+				tt_save(pos.hash, beta, depth, 0, TT_BETA, move_pack(&movelist[i]));
+			}
+			return beta;
+		}
+
+		if (score > alpha) {
 			alpha = score;
 			_updatePV(&movelist[i], 0);
-			uci_print_pv(score, depth, &infos);
+			/* The MultiPV lines are printed together once the iteration is complete */
+			if (verbose && thread->multipv == 1) {
+				uci_print_pv(score, depth, info->time_start, thread->stack[0].pv, thread->stack[0].pv_length);
+			}
 		}
 
 	}
@@ -195,53 +1109,303 @@ int search_root(int alpha, int beta, int depth)
 
 int search_alphaBeta(int alpha, int beta, int depth, int ply)
 {
-	timeControl();
+	if (thread->id == 0) {
+		timeControl();
+	}
 
-	if (infos.stop) return 0;
+	if (info->stop) return 0;
 
 	if (depth == 0) {
-		infos.nodes++;
-		return search_quiesce(alpha, beta);
+		return search_quiesce(alpha, beta, ply);
 	}
 
+	SearchStack * ss = &thread->stack[ply];
+	ss->pv_length = 0;
+
+	thread->nodes++;
+
+	if (position_isDraw(ply)) return 0;
+
+	if (ply >= MAX_PLY - 1) return eval_position();
+
 	U16 tt_flag = TT_ALPHA;
+	U16 hashMove, bestMove = 0;
 
-	int tt_val = tt_probe(pos.hash, alpha, beta, depth);
+	int tt_val = tt_probe(pos.hash, alpha, beta, depth, ply, &hashMove);
 
 	if (tt_val) return tt_val;
 
-	Move movelist[256];
+	int pv_node = (beta - alpha > 1);
+	int in_check = position_kingAttacked();
+	int static_eval = in_check ? -INFINITY : eval_position();
 	int i, score;
+
+	ss->static_eval = static_eval;
+
+	/* Not in check and better than two plies ago */
+	int improving = !in_check && (ply < 2 || static_eval > thread->stack[ply - 2].static_eval);
+
+	if (!pv_node && !in_check && !IS_MATE(beta)) {
+		/*
+		Reverse futility (static null move): the static evaluation is so far
+		above beta that a quiet move of the opponent won't bring it back.
+		*/
+		if (depth <= REVERSE_FUTILITY_DEPTH
+			&& static_eval - OPTION(OPTION_REVERSE_FUTILITY_MARGIN) * depth >= beta) {
+			return beta;
+		}
+
+		/*
+		Razoring: far below alpha near the leaves, only a capture can help.
+		Drop into the quiescence search and trust it when it fails low.
+		*/
+		if (depth <= RAZOR_DEPTH
+			&& static_eval + OPTION(OPTION_RAZOR_MARGIN) * depth <= alpha) {
+			score = search_quiesce(alpha, alpha + 1, ply);
+			if (score <= alpha) return alpha;
+		}
+	}
+
+	/*
+	Null move pruning: give the opponent a free move. If a reduced search
+	still fails high, the position is good enough to cut. This is wrong in
+	zugzwang, so the side to move must have some pieces besides its pawns.
+	*/
+	if (!pv_node && !in_check && depth >= NULL_MIN_DEPTH
+		&& !thread->null_verify
+		&& thread->stack[ply - 1].move.flags != MOVE_NULL
+		&& hasNonPawnMaterial(pos.side)
+		&& !IS_MATE(beta)
+		&& static_eval >= beta) {
+
+		Move null;
+		int R = 3 + depth / 6;
+		int null_depth = (depth - 1 - R > 0) ? depth - 1 - R : 0;
+
+		position_makeNullMove(&null);
+		ss->move = null;
+		thread->stack[ply + 1].follow_pv = 0;
+		thread->stack[ply + 1].moves = ss->moves;
+		score = -search_alphaBeta(-beta, -beta + 1, null_depth, ply + 1);
+		position_undoNullMove(&null);
+
+		if (info->stop) return 0;
+
+		if (score >= beta) {
+			/* Don't trust the mates found after a pass */
+			if (IS_MATE(score)) score = beta;
+
+			if (depth < NULL_VERIFY_DEPTH) return beta;
+
+			/* At high depth, verify with a reduced search without null moves */
+			thread->null_verify = 1;
+			score = search_alphaBeta(beta - 1, beta, null_depth, ply);
+			thread->null_verify = 0;
+
+			if (score >= beta) return beta;
+		}
+	}
+
+	Move * movelist = ss->moves;
+	Move * quiets[64];
+	int quietsCount = 0;
+	int reduction, gives_check, quiet;
 	int listLen = position_generateMoves(movelist);
 
+	/* The children generate their moves after ours */
+	thread->stack[ply + 1].moves = movelist + listLen;
+
+	if (!listLen) {
+		/* Checkmate or stalemate. Prefer the shortest mate */
+		return in_check ? -INFINITY + ply : 0;
+	}
+
+	scoreMoves(movelist, listLen, ply, hashMove);
+
+	/* Frontier nodes where the quiet moves can't raise the score up to alpha */
+	int futile = !in_check && depth <= FUTILITY_DEPTH && !IS_MATE(alpha)
+		&& static_eval + OPTION(OPTION_FUTILITY_MARGIN) * depth <= alpha;
+
+	/* Number of moves searched before the late quiet moves are pruned, fewer when not improving */
+	int late_moves = (!in_check && !pv_node && depth <= LATE_MOVE_DEPTH && !IS_MATE(alpha))
+		? (OPTION(OPTION_LATE_MOVE_COUNT) + depth * depth) / (2 - improving) : listLen;
+
 	for (i=0; i < listLen; i++)  {
+		pickMove(movelist, listLen, i);
+		quiet = IS_QUIET(movelist[i]);
 		position_makeMove(&movelist[i]);
-		score = -search_alphaBeta(-beta, -alpha, depth - 1, ply + 1);
+		gives_check = position_kingAttacked();
+
+		/*
+		Futility and late move pruning. The first move is always searched,
+		the quiet moves which give check are never pruned.
+		*/
+		if (i && quiet && !gives_check && (futile || i >= late_moves)) {
+			position_undoMove(&movelist[i]);
+			continue;
+		}
+
+		ss->move = movelist[i];
+		followPV(&movelist[i], ply);
+
+		/*
+		Late move reductions: the quiet moves ordered after the killers and
+		the counter move are searched at a reduced depth first. Less if the
+		move has a good history, more if it has a bad one.
+		*/
+		reduction = 0;
+		if (depth >= 3 && i >= 2 && !in_check
+			&& quiet && movelist[i].score < SCORE_COUNTER
+			&& !gives_check) {
+
+			reduction = reductions[depth][i < 64 ? i : 63];
+			reduction -= thread->history[1 ^ pos.side][movelist[i].from][movelist[i].to] / (HISTORY_MAX / 2);
+			if (pv_node) reduction--;
+
+			if (reduction > depth - 2) reduction = depth - 2;
+			if (reduction < 0) reduction = 0;
+		}
+
+		score = searchChild(alpha, beta, depth, ply + 1, i == 0, reduction);
 		position_undoMove(&movelist[i]);
 
+		// The scores of an interrupted search are meaningless, don't store them
+		if (info->stop) return 0;
+
 		if (score >= beta) {
+			if (IS_QUIET(movelist[i])) {
+				updateQuietStats(&movelist[i], quiets, quietsCount, depth, ply);
+			}
 			//  fail hard beta-cutoff
-			tt_save( pos.hash, beta, depth, TT_BETA);
+			tt_save(pos.hash, beta, depth, ply, TT_BETA, move_pack(&movelist[i]));
 			return beta;
 		}
 
+		if (IS_QUIET(movelist[i]) && quietsCount < 64) {
+			quiets[quietsCount++] = &movelist[i];
+		}
+
 		if (score > alpha) {
 			// alpha acts like max in MiniMax
 			alpha = score;
 			tt_flag = TT_EXACT;
+			bestMove = move_pack(&movelist[i]);
 			_updatePV(&movelist[i], ply);
 		}
 
 	}
 
-	tt_save( pos.hash, alpha, depth, tt_flag);
+	tt_save(pos.hash, alpha, depth, ply, tt_flag, bestMove);
 
 	return alpha;
 }
 
-int search_quiesce(int alpha, int beta)
+/*
+Material the move can win at best, used for delta pruning
+*/
+static int captureGain(Move * move)
+{
+	int gain = 0;
+
+	if (move->flags & MOVE_ENPASSANT) {
+		gain = eval_pieceValue[P];
+	}
+	else if (move->flags & MOVE_CAPTURE) {
+		gain = eval_pieceValue[position_pieceOn(move->to)];
+	}
+
+	if (move->flags & MOVE_PROMOTION) {
+		gain += eval_pieceValue[Q] - eval_pieceValue[P];
+	}
+
+	return gain;
+}
+
+int search_quiesce(int alpha, int beta, int ply)
 {
-	return eval_position();
+	if (thread->id == 0) {
+		timeControl();
+	}
+
+	if (info->stop) return 0;
+
+	SearchStack * ss = &thread->stack[ply];
+	ss->pv_length = 0;
+
+	thread->nodes++;
+
+	if (ply >= MAX_PLY - 1) return eval_position();
+
+	U16 hashMove, bestMove = 0;
+
+	/* Quiescence entries are stored with a depth of 0 */
+	int tt_val = tt_probe(pos.hash, alpha, beta, 0, ply, &hashMove);
+
+	if (tt_val) return tt_val;
+
+	U16 tt_flag = TT_ALPHA;
+	int stand_pat = -INFINITY;
+
+	Move * movelist = ss->moves;
+	int i, score;
+	int listLen = position_generateCaptures(movelist);
+	int in_check = pos.in_check;
+
+	thread->stack[ply + 1].moves = movelist + listLen;
+
+	if (in_check) {
+		/* All the evasions were generated, there is no stand pat when in check */
+		if (!listLen) return -INFINITY + ply;
+	} else {
+		/* The side to move can decline all the captures */
+		stand_pat = eval_position();
+
+		if (stand_pat >= beta) return beta;
+
+		if (stand_pat > alpha) {
+			alpha = stand_pat;
+			tt_flag = TT_EXACT;
+		}
+	}
+
+	for (i=0; i < listLen; i++)  {
+		/* Quiescence has no PV move, only the captures are scored */
+		movelist[i].score = (movelist[i].flags & MOVE_CAPTURE) ? SCORE_CAPTURE + mvvLva(&movelist[i]) : 0;
+		if (movelist[i].flags & MOVE_PROMOTION) movelist[i].score += SCORE_PROMOTION;
+	}
+
+	for (i=0; i < listLen; i++)  {
+		pickMove(movelist, listLen, i);
+
+		/*
+		Delta pruning: skip the captures which can't raise the score
+		up to alpha even when winning the captured piece for free
+		*/
+		if (!in_check && stand_pat + captureGain(&movelist[i]) + DELTA_MARGIN <= alpha) {
+			continue;
+		}
+
+		position_makeMove(&movelist[i]);
+		score = -search_quiesce(-beta, -alpha, ply + 1);
+		position_undoMove(&movelist[i]);
+
+		if (info->stop) return 0;
+
+		if (score >= beta) {
+			tt_save(pos.hash, beta, 0, ply, TT_BETA, move_pack(&movelist[i]));
+			return beta;
+		}
+
+		if (score > alpha) {
+			alpha = score;
+			tt_flag = TT_EXACT;
+			bestMove = move_pack(&movelist[i]);
+		}
+	}
+
+	tt_save(pos.hash, alpha, 0, ply, tt_flag, bestMove);
+
+	return alpha;
 }
 
 void search_root_negamax(int depth)
@@ -261,7 +1425,7 @@ void search_root_negamax(int depth)
 		if (score > max) {
 			max = score;
 			_updatePV(&movelist[i], 0);
-			uci_print_pv(score, depth,&infos);
+			uci_print_pv(score, depth, info->time_start, thread->stack[0].pv, thread->stack[0].pv_length);
 		}
 	}
 }
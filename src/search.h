@@ -19,23 +19,146 @@
 #ifndef SEARCH_H
 #define SEARCH_H
 
-#define MAX_DEPTH 32
+#include <stdatomic.h>
+#include "types.h"
+#include "move.h"
+#include "position.h"
+#include "eval.h"
+
+/* Deepest iteration, and deepest ply including the quiescence search */
+#define MAX_DEPTH 100
+#define MAX_PLY   128
+
+/* Room for the legal moves of any position */
+#define MAX_MOVES 256
+
+#define MAX_THREADS 128
+
+/* Most lines of a MultiPV analysis */
+#define MAX_MULTIPV 64
+
+/* Scores beyond this bound are mates, -INFINITY + ply for the side which is mated */
+#define MATE_BOUND (INFINITY - 256)
+#define IS_MATE(score) ((score) >= MATE_BOUND || (score) <= -MATE_BOUND)
 
 typedef struct {
-	int time_start;
-	int time_used;
-	int time[2];
+	/* Limits of the go command, 0 when not given */
+	int time[2];     // wtime, btime
+	int inc[2];      // winc, binc
+	int movestogo;
 	int movetime;
-	int my_side;
-	int stop;
-	int nodes;
 	int depth;
-	Move pv[MAX_DEPTH][MAX_DEPTH];
-	int pv_length[MAX_DEPTH];
+	U64 nodes;
+	int infinite;    // Search until stop, bestmove is sent after it
+	atomic_int ponder; // Searching on the opponent's time until ponderhit or stop
+
+	/* Set by search_go() */
+	U64 time_start;  // See GET_TIME()
+	U64 time_used;
+	int soft_limit;  // ms, no new iteration is started past it (scaled by the search stability)
+	int hard_limit;  // ms, the search is stopped past it
+	int my_side;
+	atomic_int stop; // Raised by the UCI thread or by the time control
+	atomic_int stop_on_ponderhit; // The time was used up while pondering
+	U64 next_check;  // Main thread node count at which the clock is read again
+	U64 next_info;   // Time before which no currmove line is printed
+	int single;      // Searched by the calling thread alone, nothing is printed (search_single())
+	Position root;   // Position to search, copied by each thread
 } SearchInfos;
 
-void* search_start(void* data);
+/* State of a search thread at one ply */
+typedef struct {
+	Move * moves;       // Moves generated at this ply, in the thread's move arena
+	Move move;          // Move made at this ply
+	Move killers[2];    // Quiet moves which caused a cutoff at this ply
+	int static_eval;    // -INFINITY when in check
+	int follow_pv;      // Reached from the root by the moves of the previous PV
+	int pv_length;
+	Move pv[MAX_PLY];   // Principal variation from this ply
+} SearchStack;
+
+/* One of the best lines of a MultiPV analysis, from the last iteration which searched it */
+typedef struct {
+	int score;
+	int depth;
+	int pv_length;
+	Move pv[MAX_PLY];
+} RootLine;
+
+/* Private state of a search thread (Lazy SMP) */
+typedef struct {
+	int id;
+	U64 nodes;
+	int depth; // Last completed iteration
+	int score; // Score of the last completed iteration
+	int pv_length;    // PV of the last completed iteration, stack[0].pv
+	Move pv[MAX_PLY]; // may hold a line of an interrupted one
+	/*
+	Allocated by the thread itself: MAX_PLY + 1 plies, and an arena of
+	MAX_PLY * MAX_MOVES moves shared by the move lists of the current line
+	*/
+	SearchStack * stack;
+	Move * arena;
+	/* Quiet move ordering, private to the thread so that helpers don't contend */
+	int history[2][64][64];          // Cutoff statistics by side, from and to squares
+	Move counters[NONE_PIECE][64];   // Refutation of the previous move, by its piece and destination
+	int null_verify;                 // Null move disabled while verifying a null move cutoff
+	/*
+	MultiPV: each iteration searches the root once per line, the moves of
+	the lines already found in this iteration being excluded
+	*/
+	RootLine * lines;                // MAX_MULTIPV lines, allocated by the thread
+	int multipv;                     // Lines searched, 1 unless the MultiPV option is set
+	int pv_index;                    // Line being searched
+} SearchThread;
+
+/* Search parameter exposed as an UCI spin option */
+typedef struct {
+	const char * name;
+	int value;
+	int min;
+	int max;
+} SearchOption;
+
+enum searchOptions {
+	OPTION_RAZOR_MARGIN,
+	OPTION_REVERSE_FUTILITY_MARGIN,
+	OPTION_FUTILITY_MARGIN,
+	OPTION_LATE_MOVE_COUNT,
+	OPTION_MULTIPV,
+	OPTIONS_COUNT
+};
+
+/* Pruning margins in centipawns, and the number of lines to report */
+extern SearchOption search_options[OPTIONS_COUNT];
+
+/* Create the search thread pool */
+void search_init();
+/* Start searching limits->root in the background */
+void search_go(SearchInfos * limits);
+/*
+Search limits->root on the calling thread, without printing anything. th
+comes from search_newThread(), the result is left in its depth, score and
+pv. limits->stop is not cleared: a stop raised before the call ends the
+search at once. Such searches may run concurrently, they only share the
+hash table and the options.
+*/
+void search_single(SearchThread * th, SearchInfos * limits);
+SearchThread * search_newThread();
+void search_freeThread(SearchThread * th);
+/* Block until the current search, if any, has printed its best move */
+void search_wait();
 void search_stop();
+/* The opponent played the expected move, the ponder search goes on as a timed search */
+void search_ponderhit();
+/* Forget the move ordering statistics (ucinewgame) */
+void search_clear();
+/* Number of threads used by the next searches (Threads UCI option) */
+void search_setThreads(int count);
+/* Set the option of the given name, returns 0 if there is no such option */
+int search_setOption(const char * name, int value);
+/* Nodes searched by all the threads since the search started */
+U64 search_nodes();
 
 // Simple perft without Transpostion table
 U64 search_perft(int depth);
@@ -47,13 +170,6 @@ int search_root(int alpha, int beta, int depth);
 void search_root_negamax(int depth);
 int search_negamax(int depth, int ply);
 int search_alphaBeta(int alpha, int beta, int depth, int ply);
-int search_quiesce(int alpha, int beta);
-
-/* 
-The total size of the triangular array in moves 
-can be calculated by the Triangular number :
-(MAX_DEPTH*MAX_DEPTH + MAX_DEPTH)/2
-*/
-// Move pv[528];
+int search_quiesce(int alpha, int beta, int ply);
 
 #endif
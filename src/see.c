@@ -0,0 +1,183 @@
+/**
+* Byak, a UCI chess engine.
+* Copyright (C) 2013  Sylvain Philip
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "bitboard.h"
+#include "magicmoves.h"
+#include "position.h"
+#include "eval.h"
+#include "see.h"
+
+#define DIAGONAL_SLIDERS(occupied) (Bmagic(to, (occupied)) & \
+	(pos.bb_pieces[B] | pos.bb_pieces[b] | pos.bb_pieces[Q] | pos.bb_pieces[q]))
+
+#define STRAIGHT_SLIDERS(occupied) (Rmagic(to, (occupied)) & \
+	(pos.bb_pieces[R] | pos.bb_pieces[r] | pos.bb_pieces[Q] | pos.bb_pieces[q]))
+
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+
+/* Least valuable first */
+static const Piece attackers_order[6] = {P, N, B, R, Q, K};
+
+/*
+Find the least valuable piece of a side among the attackers
+@return the piece (white piece type + side) or NONE_PIECE
+*/
+static inline Piece leastValuable(U64 attackers, int side, U64 *bb_piece)
+{
+	int i;
+
+	for (i=0; i < 6; i++) {
+		U64 pieces = attackers & pos.bb_pieces[attackers_order[i] + side];
+		if (pieces) {
+			*bb_piece = LS1B(pieces);
+			return attackers_order[i] + side;
+		}
+	}
+
+	return NONE_PIECE;
+}
+
+/*
+Removing a piece from the exchange square ray may uncover a slider
+behind it (x-ray). Only the sliders moving along the same line can be
+discovered: a pawn, a bishop or a queen on a diagonal, a rook or a
+queen on a file or rank.
+*/
+static inline U64 xrayAttackers(Square to, Piece piece, U64 occupied)
+{
+	switch (piece) {
+		case P: case p: case B: case b:
+			return DIAGONAL_SLIDERS(occupied);
+		case R: case r:
+			return STRAIGHT_SLIDERS(occupied);
+		case Q: case q:
+			return DIAGONAL_SLIDERS(occupied) | STRAIGHT_SLIDERS(occupied);
+		default:
+			return EMPTY;
+	}
+}
+
+int see(Move *move)
+{
+	int gain[32];
+	int d = 0;
+	Square to = move->to;
+	int side = pos.side;
+	U64 occupied = pos.bb_occupied ^ SQ64(move->from);
+	U64 bb_attacker = EMPTY;
+	Piece attacker = pos.board[move->from];
+
+	if (move->flags & MOVE_CASTLE) return 0;
+
+	if (move->flags & MOVE_ENPASSANT) {
+		gain[0] = eval_pieceValue[P];
+		occupied ^= SQ64((side == WHITE) ? to - 8 : to + 8);
+	} else {
+		gain[0] = eval_pieceValue[pos.board[to]];
+	}
+
+	if (move->flags & MOVE_PROMOTION) {
+		/* The pawn is replaced by the promoted piece */
+		Piece promoted = Q;
+		if (move->flags & MOVE_PROMOTION_ROOK) promoted = R;
+		else if (move->flags & MOVE_PROMOTION_BISHOP) promoted = B;
+		else if (move->flags & MOVE_PROMOTION_KNIGHT) promoted = N;
+
+		gain[0] += eval_pieceValue[promoted] - eval_pieceValue[P];
+		attacker = promoted + side;
+	}
+
+	U64 attackers = position_attackersTo(to, occupied) & occupied;
+
+	while (1) {
+		d++;
+		side ^= 1;
+
+		/* Speculative score if the piece on the square is captured */
+		gain[d] = eval_pieceValue[attacker] - gain[d - 1];
+
+		attacker = leastValuable(attackers, side, &bb_attacker);
+
+		if (attacker == NONE_PIECE) break;
+
+		/* The king can't capture a defended piece */
+		if ((attacker == K || attacker == k) && (attackers & pos.bb_side[1 ^ side])) break;
+
+		occupied ^= bb_attacker;
+		attackers |= xrayAttackers(to, attacker, occupied);
+		attackers &= occupied;
+
+		if (d == 31) break;
+	}
+
+	/* The last speculative score has no capture behind it */
+	while (--d) {
+		gain[d - 1] = -MAX(-gain[d - 1], gain[d]);
+	}
+
+	return gain[0];
+}
+
+int see_ge(Move *move, int threshold)
+{
+	Square to = move->to;
+
+	/* Rare cases handled by the full evaluation */
+	if (move->flags & (MOVE_PROMOTION | MOVE_ENPASSANT | MOVE_CASTLE)) {
+		return see(move) >= threshold;
+	}
+
+	/* Even a free capture doesn't reach the threshold */
+	int swap = eval_pieceValue[pos.board[to]] - threshold;
+	if (swap < 0) return 0;
+
+	/* Still above the threshold when losing the moved piece */
+	swap = eval_pieceValue[pos.board[move->from]] - swap;
+	if (swap <= 0) return 1;
+
+	int side = pos.side;
+	int result = 1;
+	U64 occupied = pos.bb_occupied ^ SQ64(move->from) ^ SQ64(to);
+	U64 attackers = position_attackersTo(to, occupied);
+	U64 bb_attacker = EMPTY;
+	Piece attacker;
+
+	while (1) {
+		side ^= 1;
+		attackers &= occupied;
+
+		attacker = leastValuable(attackers, side, &bb_attacker);
+
+		if (attacker == NONE_PIECE) break;
+
+		if (attacker == K || attacker == k) {
+			/* The king capture only stands if the other side has no attacker left */
+			return (attackers & pos.bb_side[1 ^ side]) ? result : result ^ 1;
+		}
+
+		result ^= 1;
+
+		swap = eval_pieceValue[attacker] - swap;
+		if (swap < result) break;
+
+		occupied ^= bb_attacker;
+		attackers |= xrayAttackers(to, attacker, occupied);
+	}
+
+	return result;
+}
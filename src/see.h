@@ -0,0 +1,40 @@
+/**
+* Byak, a UCI chess engine.
+* Copyright (C) 2013  Sylvain Philip
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SEE_H
+#define SEE_H
+
+#include "move.h"
+
+/**
+ * Static Exchange Evaluation
+ * Material balance in centipawns, for the side to move, of the sequence of
+ * captures on the destination square of the move, each side capturing with
+ * its least valuable attacker and being free to stop the exchange.
+ * Pins are not taken into account.
+ * @param move a legal move in the current position
+ */
+int see(Move *move);
+
+/**
+ * Return 1 if see(move) >= threshold. Faster than see() as the exchange
+ * is stopped as soon as the answer is known.
+ */
+int see_ge(Move *move, int threshold);
+
+#endif
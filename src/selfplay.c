@@ -0,0 +1,346 @@
+/**
+* Byak, a UCI chess engine.
+* Copyright (C) 2013  Sylvain Philip
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include "types.h"
+#include "bitboard.h"
+#include "position.h"
+#include "search.h"
+#include "record.h"
+#include "timer.h"
+#include "thread.h"
+#include "selfplay.h"
+
+/* Defaults of the command */
+#define DEFAULT_GAMES  100
+#define DEFAULT_NODES  5000
+#define DEFAULT_RANDOM 8     // Random plies of the openings
+
+/* Games longer than this are draws */
+#define MAX_GAME_PLIES 400
+
+/*
+Adjudication. A game is won once both sides agree on a score beyond
+WIN_SCORE for WIN_PLIES plies in a row. It is drawn when, after
+DRAW_MIN_PLY plies, the score stays within DRAW_SCORE for DRAW_PLIES plies.
+*/
+#define WIN_SCORE    1000
+#define WIN_PLIES    4
+#define DRAW_MIN_PLY 80
+#define DRAW_SCORE   10
+#define DRAW_PLIES   8
+
+/* A progress line is printed every this many games */
+#define REPORT_GAMES 100
+
+typedef struct {
+	Thread handle;
+	SearchThread * thread;
+	SearchInfos search;
+	U64 random;          // xorshift64 state
+	Record * records;    // Positions of the current game
+} Player;
+
+static Mutex lock;
+static int initialized = 0;
+
+/* State of the running games, protected by lock */
+static FILE * output;
+static int games;            // Games to play
+static int started;
+static int finished;
+static int results[3];       // By RECORD_BLACK_WINS, RECORD_DRAW and RECORD_WHITE_WINS
+static U64 positions;
+static Player * players;
+static int players_count;
+static atomic_int aborted;
+
+static SearchInfos limits;
+static int random_plies;
+static U64 seed;
+static U64 start;
+
+/* The players have their own generator, rand64() isn't thread safe */
+static U64 nextRandom(Player * player)
+{
+	player->random ^= player->random << 13;
+	player->random ^= player->random >> 7;
+	player->random ^= player->random << 17;
+
+	return player->random;
+}
+
+/* Neither side can mate: kings alone, or a king and a minor piece against a king */
+static int insufficientMaterial()
+{
+	int count = bitboard_popCount(pos.bb_occupied);
+
+	if (count == 2) return 1;
+
+	return count == 3 && (pos.bb_pieces[N] | pos.bb_pieces[n] | pos.bb_pieces[B] | pos.bb_pieces[b]);
+}
+
+/*
+Random legal plies from the start position, the opening is played again
+if the game is over before it ends
+*/
+static void playOpening(Player * player)
+{
+	Move movelist[MAX_MOVES];
+	int ply, listLen;
+
+	do {
+		position_init();
+		position_fromFen("rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1");
+
+		for (ply=0; ply < random_plies; ply++) {
+			listLen = position_generateMoves(movelist);
+			if (!listLen) break;
+
+			position_makeMove(&movelist[nextRandom(player) % listLen]);
+		}
+	} while (!position_generateMoves(movelist));
+}
+
+/* Play a game, returns the number of records of its positions */
+static int playGame(Player * player)
+{
+	Move movelist[MAX_MOVES];
+	SearchThread * th = player->thread;
+	int ply, count = 0, i;
+	int result = RECORD_DRAW;
+	int white_wins = 0, black_wins = 0, draws = 0;
+
+	playOpening(player);
+
+	for (ply=0; ply < MAX_GAME_PLIES; ply++) {
+		int listLen = position_generateMoves(movelist);
+		int score, white_score;
+		Move best;
+
+		if (!listLen) {
+			if (pos.in_check) result = (pos.side == WHITE) ? RECORD_BLACK_WINS : RECORD_WHITE_WINS;
+			break;
+		}
+
+		/* Fifty-move rule, threefold repetition */
+		if (position_isDraw(0) || insufficientMaterial()) break;
+
+		/* A stop received between two moves holds for this search */
+		mutex_lock(&lock);
+		player->search = limits;
+		player->search.stop = aborted;
+		mutex_unlock(&lock);
+
+		player->search.root = pos;
+		search_single(th, &player->search);
+
+		if (aborted) return 0;
+
+		score = th->score;
+		white_score = (pos.side == WHITE) ? score : -score;
+		best = th->pv_length ? th->pv[0] : movelist[0];
+
+		/* Quiet positions only, their static evaluation can be compared to the score */
+		if (!pos.in_check && !(best.flags & (MOVE_CAPTURE | MOVE_PROMOTION)) && !IS_MATE(score)) {
+			count += record_fromPosition(&player->records[count], white_score, RECORD_UNKNOWN);
+		}
+
+		white_wins = (white_score >= WIN_SCORE) ? white_wins + 1 : 0;
+		black_wins = (white_score <= -WIN_SCORE) ? black_wins + 1 : 0;
+		draws = (ply >= DRAW_MIN_PLY && abs(score) <= DRAW_SCORE) ? draws + 1 : 0;
+
+		if (white_wins >= WIN_PLIES) {
+			result = RECORD_WHITE_WINS;
+			break;
+		}
+		if (black_wins >= WIN_PLIES) {
+			result = RECORD_BLACK_WINS;
+			break;
+		}
+		if (draws >= DRAW_PLIES) break;
+
+		position_makeMove(&best);
+	}
+
+	for (i=0; i < count; i++) {
+		player->records[i].result = result;
+	}
+
+	mutex_lock(&lock);
+	fwrite(player->records, sizeof(Record), count, output);
+	positions += count;
+	results[result]++;
+	finished++;
+
+	if (finished % REPORT_GAMES == 0 || finished == games) {
+		U64 elapsed = GET_TIME() - start;
+
+		printf("info string games %d +%d =%d -%d positions %llu positions/hour %llu\n", finished,
+		       results[RECORD_WHITE_WINS], results[RECORD_DRAW], results[RECORD_BLACK_WINS], ULL(positions),
+		       ULL((elapsed ? positions * 3600000 / elapsed : 0)));
+		fflush(stdout);
+	}
+	mutex_unlock(&lock);
+
+	return count;
+}
+
+static void * selfplay_player(void * data)
+{
+	Player * player = data;
+	int game;
+
+	while (1) {
+		mutex_lock(&lock);
+		game = started;
+		if (aborted || started == games) {
+			mutex_unlock(&lock);
+			break;
+		}
+		started++;
+		mutex_unlock(&lock);
+
+		/* The openings only depend on the seed and the game number */
+		player->random = (seed + game + 1) * C64(0x9E3779B97F4A7C15);
+		if (!player->random) player->random = 1;
+
+		playGame(player);
+	}
+
+	return NULL;
+}
+
+void selfplay_stop()
+{
+	int i;
+
+	if (!initialized) return;
+
+	mutex_lock(&lock);
+	aborted = 1;
+	for (i=0; i < players_count; i++) {
+		players[i].search.stop = 1;
+	}
+	mutex_unlock(&lock);
+}
+
+void selfplay_run(const char * args)
+{
+	char token[256], output_path[256] = "selfplay.bin";
+	int offset = 0, read, threads = 1, i;
+
+	if (!initialized) {
+		mutex_init(&lock);
+		initialized = 1;
+	}
+
+	memset(&limits, 0, sizeof(limits));
+	games = DEFAULT_GAMES;
+	random_plies = DEFAULT_RANDOM;
+	seed = 0;
+
+	while (sscanf(args + offset, "%255s%n", token, &read) == 1) {
+		long long value = 0;
+
+		offset += read;
+
+		if (!strcmp(token, "output")) {
+			if (sscanf(args + offset, "%255s%n", output_path, &read) == 1) offset += read;
+			continue;
+		}
+
+		if (sscanf(args + offset, "%lld%n", &value, &read) == 1) offset += read;
+
+		if (!strcmp(token, "games")) {
+			games = MAX(value, 1);
+		}
+		else if (!strcmp(token, "nodes")) {
+			limits.nodes = MAX(value, 1);
+		}
+		else if (!strcmp(token, "depth")) {
+			limits.depth = MAX(value, 1);
+		}
+		else if (!strcmp(token, "threads")) {
+			threads = MIN(MAX(value, 1), MAX_THREADS);
+		}
+		else if (!strcmp(token, "random")) {
+			random_plies = MAX(value, 0);
+		}
+		else if (!strcmp(token, "seed")) {
+			seed = value;
+		}
+	}
+
+	if (!limits.nodes && !limits.depth) {
+		limits.nodes = DEFAULT_NODES;
+	}
+
+	/* Appended to, the datasets of several runs can be gathered in a file */
+	output = fopen(output_path, "ab");
+	if (!output) {
+		printf("info string cannot open %s\n", output_path);
+		return;
+	}
+
+	started = finished = 0;
+	positions = 0;
+	memset(results, 0, sizeof(results));
+	aborted = 0;
+	start = GET_TIME();
+
+	players = calloc(threads, sizeof(Player));
+
+	mutex_lock(&lock);
+	for (players_count = 0; players && players_count < threads; players_count++) {
+		Player * player = &players[players_count];
+
+		player->thread = search_newThread();
+		player->records = malloc(MAX_GAME_PLIES * sizeof(Record));
+
+		if (!player->thread || !player->records
+			|| !thread_create(&player->handle, selfplay_player, player)) {
+			search_freeThread(player->thread);
+			free(player->records);
+			break;
+		}
+	}
+	mutex_unlock(&lock);
+
+	for (i=0; i < players_count; i++) {
+		thread_join(players[i].handle);
+	}
+
+	mutex_lock(&lock);
+	for (i=0; i < players_count; i++) {
+		search_freeThread(players[i].thread);
+		free(players[i].records);
+	}
+	free(players);
+	players = NULL;
+	players_count = 0;
+	mutex_unlock(&lock);
+
+	fclose(output);
+
+	printf("info string played %d games, %llu positions written to %s in %llu ms%s\n", finished, ULL(positions),
+	       output_path, ULL(GET_TIME() - start), aborted ? ", interrupted" : "");
+}
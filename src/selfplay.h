@@ -0,0 +1,34 @@
+/**
+* Byak, a UCI chess engine.
+* Copyright (C) 2013  Sylvain Philip
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SELFPLAY_H
+#define SELFPLAY_H
+
+/*
+Self-play games generating datasets. Games are played concurrently by a
+pool of players, with fixed node searches from randomized openings. The
+quiet positions of the games are appended to the output file as records
+(see record.h), with the search score and the result of the game.
+*/
+
+/* selfplay [games x] [nodes x] [depth x] [threads x] [random x] [seed x] [output <file>] */
+void selfplay_run(const char * args);
+/* Stop the games, called by the input thread on stop and quit */
+void selfplay_stop();
+
+#endif
@@ -0,0 +1,89 @@
+/**
+* Byak, a UCI chess engine.
+* Copyright (C) 2013  Sylvain Philip
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef THREAD_H
+#define THREAD_H
+
+#if !defined(_WIN32) && !defined(_WIN64)
+
+/* Linux - Unix */
+#include <pthread.h>
+
+typedef pthread_t Thread;
+
+static inline int thread_create(Thread *thread, void *(*func)(void *), void *arg)
+{
+	return pthread_create(thread, NULL, func, arg) == 0;
+}
+
+static inline void thread_join(Thread thread)
+{
+	pthread_join(thread, NULL);
+}
+
+typedef pthread_mutex_t Mutex;
+typedef pthread_cond_t Cond;
+
+static inline void mutex_init(Mutex *mutex) { pthread_mutex_init(mutex, NULL); }
+static inline void mutex_lock(Mutex *mutex) { pthread_mutex_lock(mutex); }
+static inline void mutex_unlock(Mutex *mutex) { pthread_mutex_unlock(mutex); }
+
+static inline void cond_init(Cond *cond) { pthread_cond_init(cond, NULL); }
+static inline void cond_wait(Cond *cond, Mutex *mutex) { pthread_cond_wait(cond, mutex); }
+static inline void cond_broadcast(Cond *cond) { pthread_cond_broadcast(cond); }
+
+#else
+
+/* windows and Mingw */
+#include <windows.h>
+
+typedef HANDLE Thread;
+
+static inline int thread_create(Thread *thread, void *(*func)(void *), void *arg)
+{
+	*thread = CreateThread(
+		NULL,         // default security attributes
+		0,            // use default stack size
+		(LPTHREAD_START_ROUTINE) func, // thread function name
+		arg,          // argument to thread function
+		0,            // use default creation flags
+		NULL);        // don't need the thread identifier
+
+	return *thread != NULL;
+}
+
+static inline void thread_join(Thread thread)
+{
+	WaitForSingleObject(thread, INFINITE);
+	CloseHandle(thread);
+}
+
+typedef CRITICAL_SECTION Mutex;
+typedef CONDITION_VARIABLE Cond;
+
+static inline void mutex_init(Mutex *mutex) { InitializeCriticalSection(mutex); }
+static inline void mutex_lock(Mutex *mutex) { EnterCriticalSection(mutex); }
+static inline void mutex_unlock(Mutex *mutex) { LeaveCriticalSection(mutex); }
+
+static inline void cond_init(Cond *cond) { InitializeConditionVariable(cond); }
+static inline void cond_wait(Cond *cond, Mutex *mutex) { SleepConditionVariableCS(cond, mutex, INFINITE); }
+static inline void cond_broadcast(Cond *cond) { WakeAllConditionVariable(cond); }
+
+#endif
+
+#endif
@@ -21,13 +21,19 @@
 #include <stdlib.h>
 #include "tt.h"
 #include "prng.h"
+#include "memory.h"
+#include "search.h"
 
 Zobrist zobrist;
 
 static TranspositionTable *tt;
-static int tt_size;
+static U64 tt_size;
 
-int tt_setsize(int size) 
+/* Allocated bytes and kind of pages backing the table */
+static size_t tt_bytes;
+static PageType tt_pages;
+
+int tt_setsize(size_t size) 
 {
 	/* 
 	check if size is a power of 2
@@ -41,7 +47,9 @@ int tt_setsize(int size)
 	entries very quickly, this is used to index the entry.
 	*/
 
-	free(tt);
+	memory_freeLarge(tt, tt_bytes, tt_pages);
+	tt = NULL;
+	tt_bytes = 0;
 
 	/*
 	check if size is a power of 2
@@ -51,7 +59,7 @@ int tt_setsize(int size)
 	if (size & (size - 1)) {
 		int i;
 		size--;
-		for (i=1; i < 32; i=i*2) {
+		for (i=1; i < 64; i=i*2) {
 			size |= size >> i;
 		}
 
@@ -64,16 +72,39 @@ int tt_setsize(int size)
 		return 0;
 	}
 
+	/*
+	Random probes over a table of hundreds of MB miss the TLB on almost every
+	node with 4 kB pages. Huge pages make the whole table reachable through a
+	few hundred TLB entries.
+	*/
+	tt = (TranspositionTable *) memory_allocLarge(size, &tt_pages);
+
+	if (tt == NULL) {
+		tt_size = 0;
+		return 0;
+	}
+
+	tt_bytes = size;
 	tt_size = (size / sizeof(TranspositionTable)) -1;
-	tt = (TranspositionTable *) malloc(size);
 
 	return 1;
 }
 
+size_t tt_pagesize()
+{
+	return memory_pageSize(tt_pages);
+}
+
+void tt_print_info()
+{
+	printf("info string Hash %llu MB, %s (%llu kB)\n",
+	       ULL(tt_bytes >> 20), memory_pageName(tt_pages), ULL(tt_pagesize() >> 10));
+}
+
 /**
  * @param int size in bytes
  */
-void tt_init(int size) 
+void tt_init(size_t size) 
 {
 	int p, s, castling, ep = 0;
 	/* fill the zobrist struct with random numbers */
@@ -99,27 +130,71 @@ void tt_init(int size)
 	}
 }
 
-void tt_save(U64 hash, int val, U16 depth, U16 flag)
+/*
+The table is shared by all the search threads without locking. A concurrent
+write can leave an entry with the hash of one position and the data of
+another. Storing the hash xored with the data makes such a torn entry fail
+the signature check on probe (lockless hashing, Hyatt & Mann).
+*/
+static inline TranspositionTable tt_read(U64 hash)
+{
+	TranspositionTable entry = tt[hash & tt_size];
+	entry.hash ^= entry.data;
+	return entry;
+}
+
+static inline void tt_write(U64 hash, TranspositionTable * entry)
+{
+	TranspositionTable * slot = &tt[hash & tt_size];
+	slot->data = entry->data;
+	slot->hash = hash ^ entry->data;
+}
+
+/* Mate scores beyond this bound are -INFINITY + ply or INFINITY - ply */
+#define TT_MATE_BOUND (INFINITY - MAX_PLY)
+
+static inline int scoreToTT(int val, int ply)
+{
+	if (val > TT_MATE_BOUND) return val + ply;
+	if (val < -TT_MATE_BOUND) return val - ply;
+	return val;
+}
+
+static inline int scoreFromTT(int val, int ply)
+{
+	if (val > TT_MATE_BOUND) return val - ply;
+	if (val < -TT_MATE_BOUND) return val + ply;
+	return val;
+}
+
+void tt_save(U64 hash, int val, U16 depth, int ply, U16 flag, U16 move)
 {
 	if (!tt_size) return;
-	TranspositionTable * entry = &tt[hash & tt_size];
+	TranspositionTable entry = tt_read(hash);
 	
 	// The only criteria in deciding whether to overwrite an entry is 
 	// whether the new entry has a higher depth than the old entry if exists.
-	if ((entry->hash == hash) && (entry->depth > depth)) return;
+	if ((entry.hash == hash) && (entry.depth > depth)) return;
+
+	// A fail low has no best move, keep the one of the previous search
+	if (move || entry.hash != hash) entry.move = move;
 
-	entry->hash = hash;
-	entry->val = val;
-	entry->depth = depth;
-	entry->flag = flag;
+	entry.val = scoreToTT(val, ply);
+	entry.depth = depth;
+	entry.flag = flag;
+	tt_write(hash, &entry);
 }
 
 
-int tt_probe(U64 hash, int alpha, int beta, U16 depth)
+int tt_probe(U64 hash, int alpha, int beta, U16 depth, int ply, U16 * move)
 {
+	*move = 0;
+
 	if (!tt_size) return 0;
 
-	TranspositionTable * entry = &tt[hash & tt_size];
+	TranspositionTable entry = tt_read(hash);
+
+	if (hash == entry.hash) *move = entry.move;
 	
 	/*
 	Index collisions or type-2 errors , 
@@ -129,17 +204,18 @@ int tt_probe(U64 hash, int alpha, int beta, U16 depth)
 	the position while probing.
 	*/
 
-	if ((hash == entry->hash) && (entry->depth >= depth)) {
-		// return entry->val;
-		if (entry->flag == TT_EXACT) {
-			return entry->val;
+	if ((hash == entry.hash) && (entry.depth >= depth)) {
+		int val = scoreFromTT(entry.val, ply);
+
+		if (entry.flag == TT_EXACT) {
+			return val;
 		}
 
-		if ((entry->flag == TT_ALPHA) && (entry->val <= alpha)) {
+		if ((entry.flag == TT_ALPHA) && (val <= alpha)) {
 			return alpha;
 		}
 
-		if ((entry->flag == TT_BETA) && (entry->val >= beta)) {
+		if ((entry.flag == TT_BETA) && (val >= beta)) {
 			return beta;
 		}
 	}
@@ -150,15 +226,15 @@ int tt_probe(U64 hash, int alpha, int beta, U16 depth)
 void tt_perft_save(U64 hash, int data, int depth)
 {
 	if (!tt_size) return;
-	TranspositionTable * entry = &tt[hash & tt_size];
+	TranspositionTable entry = tt_read(hash);
 	
 	// The only criteria in deciding whether to overwrite an entry is 
 	// whether the new entry has an equal depth than the old entry if exists.
-	if ((entry->hash == hash) && (entry->depth != depth)) return;
+	if ((entry.hash == hash) && (entry.depth != depth)) return;
 
-	entry->hash = hash;
-	entry->val = data;
-	entry->depth = depth;
+	entry.val = data;
+	entry.depth = depth;
+	tt_write(hash, &entry);
 }
 
 
@@ -166,15 +242,11 @@ int tt_perft_probe(U64 hash, int depth)
 {
 	if (!tt_size) return 0;
 
-	TranspositionTable * entry = &tt[hash & tt_size];
+	TranspositionTable entry = tt_read(hash);
 
-	if (hash == entry->hash  && (entry->depth == depth)) {
-		return entry->val;
+	if (hash == entry.hash  && (entry.depth == depth)) {
+		return entry.val;
 	}
 
 	return 0;
 }
-
-
-
-
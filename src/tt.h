@@ -19,6 +19,7 @@
 #ifndef TT_H
 #define TT_H
 
+#include <stddef.h>
 #include "types.h"
 
 typedef struct {
@@ -36,19 +37,35 @@ enum ttflags {
 
 /* 16 bytes long */
 typedef struct {
+	/* Stored xored with data, see tt_save() */
 	U64 hash;
-	int val;
-	U16 depth;
-	U16 flag;
+	union {
+		U64 data;
+		struct {
+			int val;
+			U8 depth;
+			U8 flag;
+			U16 move; // Best move found, see move_pack()
+		};
+	};
 } TranspositionTable;
 
 
 extern Zobrist zobrist;
 
-void tt_init(int size);
-int tt_setsize(int size);
-void tt_save(U64 hash, int val, U16 depth, U16 flag);
-int tt_probe(U64 hash, int alpha, int beta, U16 depth);
+void tt_init(size_t size);
+int tt_setsize(size_t size);
+/* Size in bytes of the pages backing the table */
+size_t tt_pagesize();
+/* Print the table size and the kind of pages in use as an info string */
+void tt_print_info();
+/*
+Scores are relative to the root, ply is the distance of the node from the
+root: mate scores are stored relative to the node and converted back on probe.
+*/
+void tt_save(U64 hash, int val, U16 depth, int ply, U16 flag, U16 move);
+/* Returns the bounded value or 0, move receives the stored best move or 0 */
+int tt_probe(U64 hash, int alpha, int beta, U16 depth, int ply, U16 * move);
 void tt_perft_save(U64 hash, int data, int depth);
 int tt_perft_probe(U64 hash, int depth);
 
@@ -0,0 +1,434 @@
+/**
+* Byak, a UCI chess engine.
+* Copyright (C) 2013  Sylvain Philip
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "types.h"
+#include "position.h"
+#include "eval.h"
+#include "record.h"
+#include "search.h"
+#include "timer.h"
+#include "thread.h"
+#include "tune.h"
+
+/* Defaults of the command */
+#define DEFAULT_EPOCHS 300
+#define DEFAULT_RATE   1.0   // Largest step of a weight per epoch, centipawns
+
+/* Adam */
+#define BETA1   0.9
+#define BETA2   0.999
+#define EPSILON 1e-8
+
+/* Scaling constant K of the sigmoid, searched in this range */
+#define K_MIN 0.1
+#define K_MAX 3.0
+
+/* A progress line every this many epochs */
+#define REPORT_EPOCHS 10
+
+#define LN10 2.302585092994046
+
+/* A position of the dataset, its features are features[first] to features[first + count - 1] */
+typedef struct {
+	U32 first;
+	U8 count;
+	U8 result;    // RECORD_BLACK_WINS, RECORD_DRAW or RECORD_WHITE_WINS
+	S16 score;    // Search score, from white's point of view
+} Sample;
+
+/* Slice of the dataset handled by a thread during a pass */
+typedef struct {
+	Thread handle;
+	size_t first;
+	size_t last;
+	int gradient;              // Compute the gradient, or only the error
+	int threaded;              // Handled by a thread of the pool
+	double error;
+	double grad[EVAL_MAX_WEIGHTS];
+} Slice;
+
+static Sample * samples;
+static size_t samples_count;
+static EvalFeature * features;
+static size_t features_count;
+
+static double weights[EVAL_MAX_WEIGHTS];
+static int weights_count;
+static double scaling;     // K
+static double lambda;        // Weight of the search score in the target, the result has the rest
+
+/*
+Pool of the slices other than the first one, created once per tune command.
+Each pass publishes a new generation and waits until no slice is running.
+*/
+static Mutex pool_lock;
+static Cond pool_wakeup;
+static Cond pool_idle;
+static int pool_initialized = 0;
+static int pool_generation = 0;
+static int pool_running = 0;
+static int pool_exit = 0;
+
+/* Win probability of a score, from white's point of view */
+static inline double sigmoid(double score)
+{
+	return 1.0 / (1.0 + exp(-scaling * LN10 * score / 400.0));
+}
+
+/* Features of the whole dataset, extracted once */
+static int loadSamples(const char * path)
+{
+	RecordReader reader;
+	const Record * record;
+	EvalFeature position[EVAL_MAX_WEIGHTS];
+	size_t samples_size = 1 << 16, features_size = 1 << 20;
+	int count, complete = 1;
+
+	if (!record_open(&reader, path)) return 0;
+
+	samples = malloc(samples_size * sizeof(Sample));
+	features = malloc(features_size * sizeof(EvalFeature));
+
+	while (samples && features && (record = record_next(&reader))) {
+		if (record->result == RECORD_UNKNOWN || !record_toPosition(record)) continue;
+
+		count = eval_features(position);
+
+		/* The buffers are kept on failure, tune_run() frees them */
+		if (samples_count == samples_size) {
+			Sample * grown = realloc(samples, samples_size * 2 * sizeof(Sample));
+			if (!grown) {
+				complete = 0;
+				break;
+			}
+			samples = grown;
+			samples_size *= 2;
+		}
+
+		if (features_count + count > features_size) {
+			EvalFeature * grown = realloc(features, features_size * 2 * sizeof(EvalFeature));
+			if (!grown) {
+				complete = 0;
+				break;
+			}
+			features = grown;
+			features_size *= 2;
+		}
+
+		samples[samples_count].first = features_count;
+		samples[samples_count].count = count;
+		samples[samples_count].result = record->result;
+		samples[samples_count].score = record->score;
+		samples_count++;
+
+		memcpy(features + features_count, position, count * sizeof(EvalFeature));
+		features_count += count;
+	}
+
+	record_close(&reader);
+
+	return complete && samples && features;
+}
+
+static void * pass(void * data)
+{
+	Slice * slice = data;
+	size_t i;
+	int j;
+
+	slice->error = 0;
+	memset(slice->grad, 0, sizeof(slice->grad));
+
+	for (i = slice->first; i < slice->last; i++) {
+		const Sample * sample = &samples[i];
+		const EvalFeature * feature = features + sample->first;
+		double eval = 0, predicted, target, error;
+
+		for (j=0; j < sample->count; j++) {
+			eval += weights[feature[j].index] * feature[j].value;
+		}
+		eval /= EVAL_PHASE_MAX;
+
+		predicted = sigmoid(eval);
+		target = (1 - lambda) * sample->result / 2.0 + lambda * sigmoid(sample->score);
+		error = predicted - target;
+		slice->error += error * error;
+
+		if (slice->gradient) {
+			/* Derivative of the squared error by the weighted sum of the features */
+			double derivative = 2 * error * predicted * (1 - predicted) * scaling * LN10 / 400.0
+			                  / EVAL_PHASE_MAX;
+
+			for (j=0; j < sample->count; j++) {
+				slice->grad[feature[j].index] += derivative * feature[j].value;
+			}
+		}
+	}
+
+	return NULL;
+}
+
+static void * poolLoop(void * data)
+{
+	Slice * slice = data;
+	int generation = 0, stop;
+
+	while (1) {
+		mutex_lock(&pool_lock);
+		while (generation == pool_generation && !pool_exit) {
+			cond_wait(&pool_wakeup, &pool_lock);
+		}
+		generation = pool_generation;
+		stop = pool_exit;
+		mutex_unlock(&pool_lock);
+
+		if (stop) break;
+
+		pass(slice);
+
+		mutex_lock(&pool_lock);
+		pool_running--;
+		cond_broadcast(&pool_idle);
+		mutex_unlock(&pool_lock);
+	}
+
+	return NULL;
+}
+
+/* The calling thread takes the first slice, and the ones whose thread couldn't be created */
+static void poolCreate(Slice * slices, int threads)
+{
+	int i;
+
+	if (!pool_initialized) {
+		mutex_init(&pool_lock);
+		cond_init(&pool_wakeup);
+		cond_init(&pool_idle);
+		pool_initialized = 1;
+	}
+
+	/* The threads start at generation 0, a previous tune command left it higher */
+	pool_exit = 0;
+	pool_running = 0;
+	pool_generation = 0;
+
+	for (i=1; i < threads; i++) {
+		slices[i].threaded = thread_create(&slices[i].handle, poolLoop, &slices[i]);
+	}
+}
+
+static void poolDestroy(Slice * slices, int threads)
+{
+	int i;
+
+	mutex_lock(&pool_lock);
+	pool_exit = 1;
+	cond_broadcast(&pool_wakeup);
+	mutex_unlock(&pool_lock);
+
+	for (i=1; i < threads; i++) {
+		if (slices[i].threaded) thread_join(slices[i].handle);
+	}
+}
+
+/* Mean squared error of the dataset, and its gradient when grad isn't NULL */
+static double meanError(Slice * slices, int threads, double * grad)
+{
+	double error = 0;
+	int i, j;
+
+	mutex_lock(&pool_lock);
+	for (i=0; i < threads; i++) {
+		slices[i].first = samples_count * i / threads;
+		slices[i].last = samples_count * (i + 1) / threads;
+		slices[i].gradient = (grad != NULL);
+
+		if (slices[i].threaded) pool_running++;
+	}
+	pool_generation++;
+	cond_broadcast(&pool_wakeup);
+	mutex_unlock(&pool_lock);
+
+	for (i=0; i < threads; i++) {
+		if (!slices[i].threaded) pass(&slices[i]);
+	}
+
+	mutex_lock(&pool_lock);
+	while (pool_running) {
+		cond_wait(&pool_idle, &pool_lock);
+	}
+	mutex_unlock(&pool_lock);
+
+	for (i=0; i < threads; i++) {
+		error += slices[i].error;
+
+		for (j=0; grad && j < weights_count; j++) {
+			grad[j] += slices[i].grad[j];
+		}
+	}
+
+	for (j=0; grad && j < weights_count; j++) {
+		grad[j] /= samples_count;
+	}
+
+	return error / samples_count;
+}
+
+/* The K giving the smallest error with the current weights (ternary search, the error is unimodal in K) */
+static void fitK(Slice * slices, int threads)
+{
+	double low = K_MIN, high = K_MAX, error1, error2;
+	int i;
+
+	for (i=0; i < 40; i++) {
+		double k1 = low + (high - low) / 3, k2 = high - (high - low) / 3;
+
+		scaling = k1;
+		error1 = meanError(slices, threads, NULL);
+		scaling = k2;
+		error2 = meanError(slices, threads, NULL);
+
+		if (error1 < error2) {
+			high = k2;
+		} else {
+			low = k1;
+		}
+	}
+
+	scaling = (low + high) / 2;
+}
+
+void tune_run(const char * args)
+{
+	char token[256], path[256] = "", output_path[256] = "";
+	int offset = 0, read, threads = 1, epochs = DEFAULT_EPOCHS, epoch, i;
+	double rate = DEFAULT_RATE;
+	double grad[EVAL_MAX_WEIGHTS], m[EVAL_MAX_WEIGHTS] = {0}, v[EVAL_MAX_WEIGHTS] = {0};
+	int initial[EVAL_MAX_WEIGHTS], tuned[EVAL_MAX_WEIGHTS];
+	Slice * slices = NULL;
+	FILE * output = stdout;
+	U64 start = GET_TIME();
+
+	lambda = 0;
+
+	if (sscanf(args, "%255s%n", path, &read) == 1) {
+		offset += read;
+	}
+
+	while (sscanf(args + offset, "%255s%n", token, &read) == 1) {
+		double value = 0;
+
+		offset += read;
+
+		if (!strcmp(token, "output")) {
+			if (sscanf(args + offset, "%255s%n", output_path, &read) == 1) offset += read;
+			continue;
+		}
+
+		if (sscanf(args + offset, "%lf%n", &value, &read) == 1) offset += read;
+
+		if (!strcmp(token, "epochs")) {
+			epochs = MAX(value, 1);
+		}
+		else if (!strcmp(token, "threads")) {
+			threads = MIN(MAX(value, 1), MAX_THREADS);
+		}
+		else if (!strcmp(token, "rate")) {
+			rate = MAX(value, 0.001);
+		}
+		else if (!strcmp(token, "lambda")) {
+			lambda = MIN(MAX(value, 0), 1);
+		}
+	}
+
+	if (!loadSamples(path) || !samples_count) {
+		printf("info string no labeled position in %s\n", path);
+		goto end;
+	}
+
+	printf("info string %zu positions, %zu features loaded in %llu ms\n", samples_count, features_count,
+	       ULL(GET_TIME() - start));
+	fflush(stdout);
+
+	slices = calloc(threads, sizeof(Slice));
+	if (!slices) goto end;
+
+	poolCreate(slices, threads);
+
+	weights_count = eval_weights(initial);
+	for (i=0; i < weights_count; i++) {
+		weights[i] = initial[i];
+	}
+
+	fitK(slices, threads);
+
+	printf("info string K %.4f error %.6f\n", scaling, meanError(slices, threads, NULL));
+	fflush(stdout);
+
+	for (epoch = 1; epoch <= epochs; epoch++) {
+		double error;
+
+		memset(grad, 0, sizeof(grad));
+		error = meanError(slices, threads, grad);
+
+		for (i=0; i < weights_count; i++) {
+			m[i] = BETA1 * m[i] + (1 - BETA1) * grad[i];
+			v[i] = BETA2 * v[i] + (1 - BETA2) * grad[i] * grad[i];
+
+			double m_hat = m[i] / (1 - pow(BETA1, epoch));
+			double v_hat = v[i] / (1 - pow(BETA2, epoch));
+
+			weights[i] -= rate * m_hat / (sqrt(v_hat) + EPSILON);
+		}
+
+		if (epoch % REPORT_EPOCHS == 0 || epoch == epochs) {
+			printf("info string epoch %d error %.6f time %llu ms\n", epoch, error, ULL(GET_TIME() - start));
+			fflush(stdout);
+		}
+	}
+
+	for (i=0; i < weights_count; i++) {
+		tuned[i] = (int) lround(weights[i]);
+	}
+
+	if (output_path[0]) {
+		output = fopen(output_path, "w");
+		if (!output) {
+			printf("info string cannot open %s\n", output_path);
+			output = stdout;
+		}
+	}
+
+	eval_printWeights(output, tuned);
+
+	if (output != stdout) fclose(output);
+
+	poolDestroy(slices, threads);
+
+end:
+	free(slices);
+	free(samples);
+	free(features);
+	samples = NULL;
+	features = NULL;
+	samples_count = features_count = 0;
+}
@@ -0,0 +1,33 @@
+/**
+* Byak, a UCI chess engine.
+* Copyright (C) 2013  Sylvain Philip
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TUNE_H
+#define TUNE_H
+
+/*
+Texel tuning of the evaluation weights (see eval_weights()) on a file of
+records (see record.h) labeled with game results. The features of the
+positions are extracted once, then each epoch is a pass of gradient
+descent (Adam) on the mean squared error between the predicted score
+sigmoid(K * eval) and the result, spread over threads.
+*/
+
+/* tune <record-file> [epochs x] [threads x] [rate x] [lambda x] [output <file>] */
+void tune_run(const char * args);
+
+#endif
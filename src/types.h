@@ -68,11 +68,15 @@
 
 #define C64(constantU64) __UINT64_C(constantU64)
 #define ULL(integer) ((unsigned long long int) integer)
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
 
 typedef uint64_t U64;
 typedef int64_t  S64;
 typedef uint32_t  U32;
 typedef uint16_t  U16;
+typedef int16_t   S16;
+typedef int8_t    S8;
 typedef uint8_t  U8;
 
 /* This constant is for magicmoves.h */
@@ -15,14 +15,6 @@
 * You should have received a copy of the GNU General Public License
 * along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
-#if !defined(_WIN32) && !defined(_WIN64)
-/* Linux - Unix */
-#include <pthread.h>
-#else
-/* windows and Mingw */
-#include <windows.h>
-#endif
-
 #include <stdio.h>
 #include <stdlib.h> 
 #include <string.h>
@@ -32,48 +24,77 @@
 #include "position.h"
 #include "move.h"
 #include "search.h"
-#include "time.h"
+#include "see.h"
+#include "timer.h"
+#include "analyze.h"
+#include "selfplay.h"
+#include "tune.h"
 
 
+/*
+Read the number following the current token of a command
+*/
+static long long uci_read_number(const char * command, int * offset)
+{
+	long long value = 0;
+	int read = 0;
+
+	if (sscanf(command + *offset, "%lld%n", &value, &read) == 1) {
+		*offset += read;
+	}
+
+	return value;
+}
+
 static void uci_go(char * command)
 {
-	char * subcommand = NULL;
 	SearchInfos infos = {0};
+	char token[32];
+	int offset = 2, read;
 
-	infos.time[WHITE] = 0;
-	infos.time[BLACK] = 0;
-
-	if ((subcommand = strstr(command, "wtime"))) {
-		infos.time[WHITE] = atoi(subcommand+6);
-	}
+	/* go [ponder] [wtime x] [btime x] [winc x] [binc x] [movestogo x] [movetime x] [depth x] [nodes x] [infinite] */
+	while (sscanf(command + offset, "%31s%n", token, &read) == 1) {
+		offset += read;
 
-	if ((subcommand = strstr(command, "btime"))) {
-		infos.time[BLACK] = atoi(subcommand+6);
-	}
+		/* Not all the tokens have a value, nothing is read if it's not a number */
+		long long value = uci_read_number(command, &offset);
 
-	if ((subcommand = strstr(command, "infinite"))) {
-		infos.depth = MAX_DEPTH;
+		if (!strcmp(token, "wtime")) {
+			/* A flagged clock may be reported as zero or negative */
+			infos.time[WHITE] = MAX(value, 1);
+		}
+		else if (!strcmp(token, "btime")) {
+			infos.time[BLACK] = MAX(value, 1);
+		}
+		else if (!strcmp(token, "winc")) {
+			infos.inc[WHITE] = MAX(value, 0);
+		}
+		else if (!strcmp(token, "binc")) {
+			infos.inc[BLACK] = MAX(value, 0);
+		}
+		else if (!strcmp(token, "movestogo")) {
+			infos.movestogo = MAX(value, 0);
+		}
+		else if (!strcmp(token, "movetime")) {
+			infos.movetime = MAX(value, 1);
+		}
+		else if (!strcmp(token, "depth")) {
+			infos.depth = MAX(value, 1);
+		}
+		else if (!strcmp(token, "nodes")) {
+			infos.nodes = MAX(value, 1);
+		}
+		else if (!strcmp(token, "infinite")) {
+			infos.infinite = 1;
+		}
+		else if (!strcmp(token, "ponder")) {
+			infos.ponder = 1;
+		}
 	}
 
-	#if !defined(_WIN32) && !defined(_WIN64)
-	/* Linux - Unix */
-	pthread_t SearchThread;
-	pthread_create(&SearchThread, NULL, search_start, &infos);
-	/* Don't need to call pthread_join() as the thread never calls pthread_exit() */
-	#else
-	/* windows and Mingw */
-	HANDLE SearchThread;
-	DWORD  threadId;
-	SearchThread = CreateThread( 
-		NULL,         // default security attributes
-		0,            // use default stack size  
-		(LPTHREAD_START_ROUTINE) search_start, // thread function name
-		&infos,       // argument to thread function 
-		0,            // use default creation flags 
-		&threadId);   // returns the thread identifier
+	infos.root = pos;
 
-		CloseHandle(SearchThread);
-	#endif
+	search_go(&infos);
 }
 
 static Move uci_prepare_move(U64 from, U64 to, Piece promotion )
@@ -102,7 +123,7 @@ static Move uci_prepare_move(U64 from, U64 to, Piece promotion )
 			case Q : move.flags |= MOVE_PROMOTION_QUEEN; break;
 			case R : move.flags |= MOVE_PROMOTION_ROOK; break;
 			case B : move.flags |= MOVE_PROMOTION_BISHOP; break;
-			case K : move.flags |= MOVE_PROMOTION_KNIGHT; break;
+			case N : move.flags |= MOVE_PROMOTION_KNIGHT; break;
 			default: break;
 		}
 	}
@@ -162,9 +183,58 @@ static void uci_parse_moves(const char * moves)
 	}
 }
 
+/* Last position command, the current position results from it */
+static char * uci_last_position = NULL;
+
+/*
+position [fen | startpos] [moves ...]
+
+During a game the GUI sends the whole game again with the new moves
+appended. When the command extends the previous one, only these moves are
+played on the current position, which also keeps the keys of the game for
+the repetition detection.
+*/
+static void uci_position(const char * command)
+{
+	size_t length = uci_last_position ? strlen(uci_last_position) : 0;
+	const char * moves = NULL;
+
+	if (length && !strncmp(command, uci_last_position, length) && (!command[length] || command[length] == ' ')) {
+		moves = command + length;
+
+		if (!strstr(uci_last_position, " moves") && moves[0]) {
+			/* Anything else than the first moves changes the starting position */
+			moves = strncmp(moves, " moves", 6) ? NULL : moves + 6;
+		}
+	}
+
+	if (moves) {
+		uci_parse_moves(moves);
+	} else {
+		position_init();
+
+		if (!strncmp(command,"position fen",12)) {
+			position_fromFen(command + 13);
+		} else {
+			position_fromFen("rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1");
+		}
+
+		moves = strstr(command, "moves");
+		if (moves) {
+			uci_parse_moves(moves + 5);
+		}
+	}
+
+	length = strlen(command) + 1;
+	free(uci_last_position);
+	uci_last_position = malloc(length);
+	if (uci_last_position) memcpy(uci_last_position, command, length);
+}
+
 static void uci_ext_perft(int depth, int use_tt)
 {
-	int start, timeused;
+	U64 start;
+	int timeused;
 	float nps;
 	U64 nodes;
 
@@ -184,6 +254,52 @@ static void uci_ext_perft(int depth, int use_tt)
 }
 
 
+/*
+Print the exchange value of each capture of the current position, then
+benchmark see() and see_ge() over these captures
+*/
+static void uci_ext_see(int iterations)
+{
+	Move movelist[256];
+	int i, j, timeused;
+	U64 start;
+	int listlen = position_generateCaptures(movelist);
+	volatile int sink = 0;
+	U64 calls;
+
+	for (i=0; i < listlen; i++) {
+		move_displayAlg(&movelist[i]);
+		printf(" : %i\n", see(&movelist[i]));
+	}
+
+	if (!listlen) return;
+
+	if (iterations < 1) iterations = 1000000;
+
+	start = GET_TIME();
+
+	for (j=0; j < iterations; j++) {
+		for (i=0; i < listlen; i++) {
+			sink += see(&movelist[i]);
+		}
+	}
+
+	timeused = GET_TIME() - start;
+	calls = (U64) iterations * listlen;
+	printf("see;calls:%llu;time:%i;calls/s:%.0f\n", ULL(calls), timeused, (float) calls / ((float) (timeused + 1) / 1000));
+
+	start = GET_TIME();
+
+	for (j=0; j < iterations; j++) {
+		for (i=0; i < listlen; i++) {
+			sink += see_ge(&movelist[i], 0);
+		}
+	}
+
+	timeused = GET_TIME() - start;
+	printf("see_ge;calls:%llu;time:%i;calls/s:%.0f\n", ULL(calls), timeused, (float) calls / ((float) (timeused + 1) / 1000));
+}
+
 void uci_ext_divide(int depth)
 {
 	U64 nodes = 0;
@@ -210,14 +326,60 @@ void uci_ext_divide(int depth)
 }
 
 
+void uci_signal(const char * command)
+{
+	/*
+	The command is queued as well. If it arrives before the go it refers to
+	has been executed, the queued copy applies it to that search.
+	*/
+	if (!strcmp(command, "stop") || !strcmp(command, "quit")) {
+		search_stop();
+		analyze_stop();
+		selfplay_stop();
+	}
+
+	if (!strcmp(command, "ponderhit")) {
+		search_ponderhit();
+	}
+}
+
+/*
+Commands which change the state shared with the search threads (hash
+table, options, history) wait until the search is over
+*/
+static int uci_needs_idle(const char * command)
+{
+	static const char * commands[] = {"position", "setoption", "ucinewgame", "perft", "divide", "analyze", "analysegame", "selfplay", "tune", NULL};
+	int i;
+
+	for (i=0; commands[i]; i++) {
+		if (!strncmp(command, commands[i], strlen(commands[i]))) return 1;
+	}
+
+	return 0;
+}
+
 void uci_exec(char * command)
 {
+	if (uci_needs_idle(command)) {
+		search_wait();
+	}
+
 	if (!strcmp(command, "uci")) {
 		printf("id name chess_engine\n");
 		printf("id author Sylvain Philip\n");
 
-		/* the engine can change the hash size from 1 to 128 MB */
-		printf("option name Hash type spin default 64 min 1 max 1024\n");
+		/* the engine can change the hash size from 1 MB to 64 GB */
+		printf("option name Hash type spin default 64 min 1 max 65536\n");
+		printf("option name Threads type spin default 1 min 1 max %d\n", MAX_THREADS);
+		/* Tells the GUI that the engine can ponder, the engine itself doesn't need it */
+		printf("option name Ponder type check default false\n");
+
+		int i;
+		for (i=0; i < OPTIONS_COUNT; i++) {
+			printf("option name %s type spin default %d min %d max %d\n", search_options[i].name,
+			       search_options[i].value, search_options[i].min, search_options[i].max);
+		}
 		/* the engine has sent all parameters and is ready */
 		printf("uciok\n");
 	}
@@ -233,31 +395,28 @@ void uci_exec(char * command)
 		sscanf(command, "setoption name %255s value %255s", name, value);
 
 		if (!strcmp(name, "Hash")) {
-			int val;
-			sscanf(value, "%4u", &val);
+			unsigned int val = 0;
+			sscanf(value, "%6u", &val);
 			/* transform val to a power of two number */
-			tt_setsize(val << 20);
+			tt_setsize((size_t) val << 20);
+			tt_print_info();
+		}
+		else if (!strcmp(name, "Threads")) {
+			search_setThreads(atoi(value));
+		}
+		else {
+			search_setOption(name, atoi(value));
 		}
 	}
 
 	if (!strcmp(command, "ucinewgame")) {
-		
+		search_clear();
+		free(uci_last_position);
+		uci_last_position = NULL;
 	}
 
 	if (!strncmp(command, "position", 8)) {
-		/* position [fen | startpos] [moves ...] */
-		position_init();
-
-		if (!strncmp(command,"position fen",12)) {
-			position_fromFen(command + 13);
-		} else {
-			position_fromFen("rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1");
-		}
-
-		char * moves = strstr(command, "moves");
-		if (moves) {
-			uci_parse_moves(moves+6);
-		}
+		uci_position(command);
 	}
 	
 	if (!strncmp(command, "go", 2)) {
@@ -271,9 +430,7 @@ void uci_exec(char * command)
 	}
 
 	if (!strcmp(command, "ponderhit")) {
-		/*
-		time_uci_ponderhit();
-		*/
+		search_ponderhit();
 	}
 
 	if (!strcmp(command, "stop")) {
@@ -281,6 +438,8 @@ void uci_exec(char * command)
 	}
 
 	if (!strcmp(command, "quit")) {
+		search_stop();
+		search_wait();
 		exit(EXIT_SUCCESS);
 	}
 
@@ -309,47 +468,120 @@ void uci_exec(char * command)
 		uci_ext_divide(atoi(command + 7));
 	}
 
+	if (!strncmp(command, "see", 3)) {
+		uci_ext_see(atoi(command + 3));
+	}
+
 	if (!strncmp(command, "eval", 4)) {
 		printf("score: %i \n", eval_position());
 	}
 
+	if (!strncmp(command, "analyze ", 8)) {
+		analyze_run(command + 8);
+	}
+
+	if (!strncmp(command, "analysegame ", 12)) {
+		analyze_game(command + 12);
+	}
+
+	if (!strncmp(command, "selfplay", 8)) {
+		selfplay_run(command + 8);
+	}
+
+	if (!strncmp(command, "tune ", 5)) {
+		tune_run(command + 5);
+	}
+
+}
+
+/*
+Lines printed while searching are built in a buffer and written at once: a
+single write per line, and the lines of the search and of the UCI threads
+never interleave. stdout is fully buffered, it is flushed at line boundaries.
+*/
+static void uci_send(const char * line)
+{
+	fputs(line, stdout);
+	fflush(stdout);
+}
+
+int uci_format_move(char * buffer, Move * move)
+{
+	int length = sprintf(buffer, "%s%s", bitboard_binToAlg(SQ64(move->from)), bitboard_binToAlg(SQ64(move->to)));
+
+	if (move->flags & MOVE_PROMOTION) {
+		length += sprintf(buffer + length, "%c", move_getPromotionPieceChar(move->flags));
+	}
+
+	return length;
 }
 
 void uci_print_move(Move *move)
 {
-	printf("%s%s%c", bitboard_binToAlg(SQ64(move->from)),
-					 bitboard_binToAlg(SQ64(move->to)), 
-					 move_getPromotionPieceChar(move->flags));
+	char buffer[8];
+
+	uci_format_move(buffer, move);
+	fputs(buffer, stdout);
 }
 
 void uci_print_currmove(Move * move, int depth, int mvNbr)
 {
-	printf("info depth %d currmove ", depth);
-	uci_print_move(move);
-	printf(" currmovenumber %d\n",  mvNbr);
+	char line[64];
+	int length = sprintf(line, "info depth %d currmove ", depth);
+
+	length += uci_format_move(line + length, move);
+	sprintf(line + length, " currmovenumber %d\n", mvNbr);
+	uci_send(line);
 }
 
-void uci_print_pv(int score, int depth, SearchInfos * infos)
+/* index is the MultiPV line number, 0 when a single line is searched */
+static void uci_send_pv(int index, int score, int depth, U64 time_start, Move * pv, int pv_length)
 {
-	int timeused = GET_TIME() - infos->time_start;
-	
-	printf("info depth %i score cp %i nodes %i time %i", depth, score, infos->nodes, timeused);
+	/* Room for MAX_PLY moves of 6 characters */
+	char line[128 + MAX_PLY * 6];
+	int timeused = GET_TIME() - time_start;
+	int length, j;
 
-	printf(" pv ");
+	length = sprintf(line, "info depth %i", depth);
 
-	int j;
-	for (j = 0; j < infos->pv_length[0]; ++j) {
-		uci_print_move(&infos->pv[0][j]);
-		printf(" ");
+	if (index) {
+		length += sprintf(line + length, " multipv %i", index);
 	}
 
-	printf("\n");
+	if (IS_MATE(score)) {
+		/* Moves to the mate, negative when the engine is mated */
+		int mate = (INFINITY - abs(score) + 1) / 2;
+		length += sprintf(line + length, " score mate %i", score > 0 ? mate : -mate);
+	} else {
+		length += sprintf(line + length, " score cp %i", score);
+	}
+
+	length += sprintf(line + length, " nodes %llu time %i pv", ULL(search_nodes()), timeused);
+
+	for (j = 0; j < pv_length; ++j) {
+		line[length++] = ' ';
+		length += uci_format_move(line + length, &pv[j]);
+	}
+
+	sprintf(line + length, "\n");
+	uci_send(line);
+}
+
+void uci_print_pv(int score, int depth, U64 time_start, Move * pv, int pv_length)
+{
+	uci_send_pv(0, score, depth, time_start, pv, pv_length);
 }
 
-void uci_print_nps(int time_start, int nodes)
+void uci_print_multipv(int index, RootLine * line, U64 time_start)
+{
+	uci_send_pv(index, line->score, line->depth, time_start, line->pv, line->pv_length);
+}
+
+void uci_print_nps(U64 time_start, U64 nodes)
 {
 	if (!nodes) return;
 	float time_used_in_sec, nps;
+	char line[64];
 
 	time_used_in_sec = (float) (GET_TIME() - time_start) / 1000;
 
@@ -357,15 +589,26 @@ void uci_print_nps(int time_start, int nodes)
 
 	nps = (float) nodes / time_used_in_sec;
 
-	printf("info nps %.0f\n", nps);
+	sprintf(line, "info nps %.0f\n", nps);
+	uci_send(line);
 }
 
-void uci_print_bestmove(Move * move)
+void uci_print_bestmove(Move * move, Move * ponder)
 {
-	printf("bestmove ");
-	uci_print_move(move);
-	printf("\n");
-}
-
+	char line[32];
+	int length = sprintf(line, "bestmove ");
 
+	if (!move) {
+		/* The null move of the UCI protocol */
+		uci_send("bestmove 0000\n");
+		return;
+	}
 
+	length += uci_format_move(line + length, move);
+	if (ponder) {
+		length += sprintf(line + length, " ponder ");
+		length += uci_format_move(line + length, ponder);
+	}
+	sprintf(line + length, "\n");
+	uci_send(line);
+}
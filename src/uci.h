@@ -21,9 +21,14 @@
 #include "search.h"
 
 void uci_exec(char * command);
+/* Called by the input thread as soon as a command is read, for stop, ponderhit and quit */
+void uci_signal(const char * command);
+/* Write the move in coordinate notation, returns the number of characters written */
+int uci_format_move(char * buffer, Move * move);
 void uci_print_move(Move *move);
 void uci_print_currmove(Move * move, int depth, int mvNbr);
-void uci_print_pv(int score, int depth, SearchInfos * infos);
-void uci_print_nps(int time_start, int nodes);
-void uci_print_bestmove(Move * move);
+void uci_print_pv(int score, int depth, U64 time_start, Move * pv, int pv_length);
+void uci_print_multipv(int index, RootLine * line, U64 time_start);
+void uci_print_nps(U64 time_start, U64 nodes);
+void uci_print_bestmove(Move * move, Move * ponder);
 #endif
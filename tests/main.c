@@ -27,6 +27,11 @@
 #include "move.h"
 #include "prng.h"
 #include "tt.h"
+#include "see.h"
+#include "record.h"
+#include "eval.h"
+#include "search.h"
+#include "timer.h"
 
 /* ************** Test suite functions below ************** */
 static void test_fen()
@@ -254,10 +259,293 @@ static void test_alg2bin()
 	assert(bitboard_algToBin("h8") == C64(1) << h8);
 }
 
+/* Find a legal move by its squares in the current position */
+static Move findMove(Square from, Square to)
+{
+	Move movelist[256];
+	int i, listlen = position_generateMoves(movelist);
+
+	for (i=0; i < listlen; i++) {
+		if (movelist[i].from == from && movelist[i].to == to) return movelist[i];
+	}
+
+	assert(0);
+	return movelist[0];
+}
+
+static void test_see()
+{
+	Move move;
+	printf("Test static exchange evaluation\n");
+
+	/* Undefended pawn */
+	position_init();
+	position_fromFen("1k1r4/1pp4p/p7/4p3/8/P5P1/1PP4P/2K1R3 w - - 0 1");
+	move = findMove(e1, e5);
+	assert(see(&move) == 100);
+	assert(see_ge(&move, 100));
+	assert(!see_ge(&move, 101));
+
+	/* Knight takes a defended pawn, with x-rayed sliders on both sides */
+	position_init();
+	position_fromFen("1k1r3q/1ppn3p/p4b2/4p3/8/P2N2P1/1PP1R1BP/2K1Q3 w - - 0 1");
+	move = findMove(d3, e5);
+	assert(see(&move) == -200);
+	assert(see_ge(&move, -200));
+	assert(!see_ge(&move, -199));
+	move = findMove(e2, e5);
+	assert(see(&move) == -500);
+
+	/* The king recaptures an undefended piece, not a defended one */
+	position_init();
+	position_fromFen("8/4k3/3p4/8/1B6/8/8/4K3 w - - 0 1");
+	move = findMove(b4, d6);
+	assert(see(&move) == -200);
+	assert(!see_ge(&move, 0));
+	position_init();
+	position_fromFen("8/4k3/3p4/8/1B6/8/8/3RK3 w - - 0 1");
+	move = findMove(b4, d6);
+	assert(see(&move) == 100);
+	assert(see_ge(&move, 100));
+
+	/* Pawn takes a piece defended by a pawn */
+	position_init();
+	position_fromFen("4k3/8/2p5/3n4/4P3/8/8/4K3 w - - 0 1");
+	move = findMove(e4, d5);
+	assert(see(&move) == 200);
+	assert(see_ge(&move, 200));
+	assert(!see_ge(&move, 201));
+	position_init();
+	position_fromFen("4k3/8/2p5/3r4/4P3/8/8/4K3 w - - 0 1");
+	move = findMove(e4, d5);
+	assert(see(&move) == 500);
+	assert(see_ge(&move, 500));
+	assert(!see_ge(&move, 501));
+
+	/* Quiet moves to a square attacked by a pawn, and to a safe one */
+	position_init();
+	position_fromFen("4k3/8/3p4/8/8/1N6/8/4K3 w - - 0 1");
+	move = findMove(b3, c5);
+	assert(see(&move) == -300);
+	assert(!see_ge(&move, 0));
+	move = findMove(b3, d4);
+	assert(see(&move) == 0);
+	assert(see_ge(&move, 0));
+}
+
+static void test_nullMove()
+{
+	Move null;
+	U64 hash;
+	printf("Test null move\n");
+
+	position_init();
+	position_fromFen("rnbqkbnr/ppp1pppp/8/8/3pP3/8/PPPP1PPP/RNBQKBNR b KQkq e3 0 3");
+	hash = pos.hash;
+	assert(pos.enpassant == e3);
+	assert(!position_kingAttacked());
+
+	position_makeNullMove(&null);
+	assert(pos.side == WHITE);
+	assert(pos.enpassant == NONE_SQUARE);
+	assert(pos.hash != hash);
+
+	position_undoNullMove(&null);
+	assert(pos.side == BLACK);
+	assert(pos.enpassant == e3);
+	assert(pos.hash == hash);
+
+	position_init();
+	position_fromFen("4k3/8/8/8/8/8/8/R3K2r w - - 0 1");
+	assert(position_kingAttacked());
+}
+
+static void playMove(Square from, Square to)
+{
+	Move move = findMove(from, to);
+	position_makeMove(&move);
+}
+
+static void test_draw()
+{
+	int i;
+	printf("Test draw detection\n");
+
+	position_init();
+	position_fromFen("rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1");
+
+	for (i=0; i < 2; i++) {
+		playMove(g1, f3);
+		playMove(g8, f6);
+		playMove(f3, g1);
+		playMove(f6, g8);
+
+		/* Once repeated, it's only a draw inside the search */
+		if (i == 0) {
+			assert(!position_isDraw(0));
+			assert(position_isDraw(5));
+		}
+	}
+
+	/* Threefold repetition */
+	assert(pos.halfmove == 8);
+	assert(pos.fullmove == 5);
+	assert(position_isDraw(0));
+
+	/* An irreversible move ends the sequence */
+	playMove(e2, e4);
+	assert(pos.halfmove == 0);
+	assert(!position_isDraw(0));
+
+	/* Fifty-move rule */
+	position_init();
+	position_fromFen("4k3/8/8/8/8/8/8/4K2R w - - 99 80");
+	assert(pos.halfmove == 99);
+	assert(pos.fullmove == 80);
+	assert(!position_isDraw(0));
+	playMove(h1, h2);
+	assert(position_isDraw(0));
+}
+
+static void test_record()
+{
+	static const char * fens[] = {
+		"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+		"r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+		"rnbqkbnr/pp1ppppp/8/2pP4/8/8/PPP1PPPP/RNBQKBNR w Kq c6 12 34",
+		"8/2k5/8/8/8/8/8/1K5R b - - 99 150",
+		NULL
+	};
+	char fen[128];
+	Record record;
+	U64 hash;
+	int i;
+
+	printf("Test position records\n");
+
+	assert(sizeof(Record) == 32);
+
+	for (i=0; fens[i]; i++) {
+		position_init();
+		position_fromFen(fens[i]);
+		position_toFen(fen);
+		assert(!strcmp(fen, fens[i]));
+		hash = pos.hash;
+
+		assert(record_fromFen(&record, fens[i], -120, RECORD_DRAW));
+		assert(record.score == -120 && record.result == RECORD_DRAW);
+		assert(record_toFen(&record, fen));
+		assert(!strcmp(fen, fens[i]));
+		assert(pos.hash == hash);
+	}
+
+	/* The keys of a FEN are the ones reached by making the moves */
+	position_init();
+	position_fromFen(fens[0]);
+	playMove(e2, e4);
+	playMove(c7, c5);
+	hash = pos.hash;
+	position_toFen(fen);
+	position_init();
+	position_fromFen(fen);
+	assert(pos.hash == hash);
+}
+
+/* The weighted features of a position give its evaluation */
+static void test_evalFeatures()
+{
+	static const char * fens[] = {
+		"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+		"r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R b KQkq - 0 1",
+		"r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10",
+		"8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+		"n1n5/PPPk4/8/8/8/8/4Kppp/5N1N b - - 0 1",
+		NULL
+	};
+	EvalFeature features[EVAL_MAX_WEIGHTS];
+	int weights[EVAL_MAX_WEIGHTS];
+	Move movelist[256];
+	Position saved;
+	char fen[128];
+	int i, j, count, score, psq_mg, psq_eg, phase;
+
+	printf("Test evaluation features\n");
+
+	eval_init();
+	eval_weights(weights);
+
+	for (i=0; fens[i]; i++) {
+		position_init();
+		position_fromFen(fens[i]);
+
+		count = eval_features(features);
+		for (score = 0, j = 0; j < count; j++) {
+			score += weights[features[j].index] * features[j].value;
+		}
+
+		assert(score / EVAL_PHASE_MAX == eval_position() * (pos.side == WHITE ? 1 : -1));
+
+		/* The sums updated by the moves are those of the positions set up from scratch */
+		count = position_generateMoves(movelist);
+		psq_mg = pos.psq_mg;
+		psq_eg = pos.psq_eg;
+		phase = pos.phase;
+
+		for (j=0; j < count; j++) {
+			position_makeMove(&movelist[j]);
+			position_toFen(fen);
+			saved = pos;
+
+			position_init();
+			position_fromFen(fen);
+			assert(pos.psq_mg == saved.psq_mg && pos.psq_eg == saved.psq_eg && pos.phase == saved.phase);
+
+			pos = saved;
+			position_undoMove(&movelist[j]);
+			assert(pos.psq_mg == psq_mg && pos.psq_eg == psq_eg && pos.phase == phase);
+		}
+	}
+}
+
+static void test_searchThreads()
+{
+	SearchInfos limits;
+	U64 start;
+	int i;
+
+	printf("Test changing the threads between searches\n");
+
+	eval_init();
+	search_init();
+
+	position_init();
+	position_fromFen("rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1");
+
+	for (i=0; i < 6; i++) {
+		memset(&limits, 0, sizeof(limits));
+		limits.depth = 4;
+		limits.root = pos;
+
+		search_go(&limits);
+		search_wait();
+		assert(search_nodes() > 0);
+
+		/* The new threads wait for the next search, they don't replay the last one */
+		search_setThreads(2 + i % 3);
+		start = GET_TIME();
+		while (GET_TIME() - start < 20);
+		assert(search_nodes() == 0);
+	}
+
+	search_setThreads(1);
+}
+
 int main (int argc, char ** argv) {
 
 	bitboard_init();
 	prng_init(73);
+	/* Fills the zobrist keys */
+	tt_init(1 << 20);
 
 	printf("Byak tests suite\n");
 
@@ -271,6 +559,12 @@ int main (int argc, char ** argv) {
 	test_magicMoves();
 	testInBetweenSquares();
 	test_fen();
+	test_see();
+	test_nullMove();
+	test_draw();
+	test_record();
+	test_evalFeatures();
+	test_searchThreads();
 
 	return 0;
 }